@@ -0,0 +1,951 @@
+/*
+ * microbenchmarks for the libev hot paths.
+ *
+ * usage: bench [-b backends] [-n maxtimers] [benchmark...]
+ *
+ * runs the given benchmarks (default: all) and prints one tab-separated
+ * line per result:
+ *
+ *    benchmark  backend  n  value  unit
+ *
+ * lines starting with # are comments. benchmarks that exercise the
+ * backend run once for every backend in -b (a mask of EVBACKEND_*
+ * values, default select, poll, epoll and io_uring, as far as they
+ * are supported), the others run on the default backend only and
+ * print - as backend.
+ *
+ * build and run with "make bench".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+
+#include "ev.h"
+
+static unsigned int backends = EVBACKEND_SELECT | EVBACKEND_POLL | EVBACKEND_EPOLL | EVBACKEND_IOURING;
+static int maxtimers = 1000000;
+
+static const char *
+backend_name (unsigned int backend)
+{
+  switch (backend)
+    {
+      case EVBACKEND_SELECT:  return "select";
+      case EVBACKEND_POLL:    return "poll";
+      case EVBACKEND_EPOLL:   return "epoll";
+      case EVBACKEND_IOURING: return "iouring";
+      case EVBACKEND_KQUEUE:  return "kqueue";
+      case EVBACKEND_PORT:    return "port";
+      default:                return "-";
+    }
+}
+
+static void
+result (const char *name, unsigned int backend, int n, double value, const char *unit)
+{
+  printf ("%s\t%s\t%d\t%.1f\t%s\n", name, backend_name (backend), n, value, unit);
+  fflush (stdout);
+}
+
+/*****************************************************************************/
+
+static void
+timer_cb (EV_P_ ev_timer *w, int revents)
+{
+}
+
+/*
+ * start, restart and stop n timers with random timeouts, none of which
+ * expire, then let n repeating timers expire at once.
+ */
+static void
+bench_timer (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (EVFLAG_AUTO);
+  int n, i;
+
+  for (n = 1000; n <= maxtimers; n *= 10)
+    {
+      ev_timer *timers = malloc (sizeof (ev_timer) * n);
+      ev_tstamp start;
+
+      if (!timers)
+        break;
+
+      srand (n);
+
+      for (i = 0; i < n; ++i)
+        {
+          ev_tstamp after = 1000. + rand () % 1000000 * 1e-3;
+          ev_timer_init (timers + i, timer_cb, after, after);
+        }
+
+      start = ev_time ();
+      for (i = 0; i < n; ++i)
+        ev_timer_start (loop, timers + i);
+      result ("timer_start", 0, n, (ev_time () - start) * 1e9 / n, "ns/op");
+
+      /* let some time pass, so ev_timer_again has to move the timers */
+      ev_run (loop, EVRUN_NOWAIT);
+
+      start = ev_time ();
+      for (i = 0; i < n; ++i)
+        {
+          timers [i].repeat = 1000. + rand () % 1000000 * 1e-3;
+          ev_timer_again (loop, timers + i);
+        }
+      result ("timer_again", 0, n, (ev_time () - start) * 1e9 / n, "ns/op");
+
+      start = ev_time ();
+      for (i = 0; i < n; ++i)
+        ev_timer_stop (loop, timers + i);
+      result ("timer_stop", 0, n, (ev_time () - start) * 1e9 / n, "ns/op");
+
+      /* let all timers expire within a millisecond: every expiry moves */
+      /* the repeating timer from the root back down the heap */
+      for (i = 0; i < n; ++i)
+        {
+          ev_timer_set (timers + i, rand () % 1000 * 1e-6, 1000. + rand () % 1000000 * 1e-3);
+          ev_timer_start (loop, timers + i);
+        }
+
+      ev_sleep (2e-3);
+
+      start = ev_time ();
+      ev_run (loop, EVRUN_NOWAIT);
+      result ("timer_reify", 0, n, (ev_time () - start) * 1e9 / n, "ns/timer");
+
+      for (i = 0; i < n; ++i)
+        ev_timer_stop (loop, timers + i);
+
+      free (timers);
+    }
+
+  ev_loop_destroy (loop);
+}
+
+/*****************************************************************************/
+
+#define IO_FDS    1000
+#define IO_ROUNDS 200
+
+static void
+io_cb (EV_P_ ev_io *w, int revents)
+{
+}
+
+/*
+ * stop, modify and restart the watchers of IO_FDS writable sockets, then
+ * poll once, so every round changes (and reports) every fd.
+ */
+static void
+bench_io (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (backend);
+  static ev_io ios [IO_FDS];
+  int fds [IO_FDS][2];
+  int nfds, round, i;
+  ev_tstamp start;
+
+  if (!loop)
+    return;
+
+  /* select is usually limited to FD_SETSIZE */
+  for (nfds = 0; nfds < IO_FDS; ++nfds)
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds [nfds]))
+      break;
+    else if (fds [nfds][1] >= 1000)
+      {
+        close (fds [nfds][0]);
+        close (fds [nfds][1]);
+        break;
+      }
+
+  for (i = 0; i < nfds; ++i)
+    {
+      ev_io_init (ios + i, io_cb, fds [i][0], EV_READ);
+      ev_io_start (loop, ios + i);
+    }
+
+  ev_run (loop, EVRUN_NOWAIT);
+
+  start = ev_time ();
+  for (round = 0; round < IO_ROUNDS; ++round)
+    {
+      for (i = 0; i < nfds; ++i)
+        {
+          ev_io_stop (loop, ios + i);
+          ev_io_set (ios + i, fds [i][0], round & 1 ? EV_READ : EV_READ | EV_WRITE);
+          ev_io_start (loop, ios + i);
+        }
+
+      ev_run (loop, EVRUN_NOWAIT);
+    }
+  result ("io_churn", backend, nfds, (ev_time () - start) * 1e9 / (IO_ROUNDS * nfds), "ns/fd");
+
+  for (i = 0; i < nfds; ++i)
+    {
+      ev_io_stop (loop, ios + i);
+      close (fds [i][0]);
+      close (fds [i][1]);
+    }
+
+  ev_loop_destroy (loop);
+}
+
+/*****************************************************************************/
+
+#define PINGPONGS 100000
+
+static struct ev_loop *ping_loop, *pong_loop;
+static ev_async ping_w, pong_w;
+static int pingpongs;
+static int volatile pingpong_done;
+
+static void
+ping_cb (EV_P_ ev_async *w, int revents)
+{
+  if (++pingpongs == PINGPONGS)
+    {
+      pingpong_done = 1; /* ev_async_send provides the memory barrier */
+      ev_break (EV_A_ EVBREAK_ALL);
+    }
+
+  ev_async_send (pong_loop, &pong_w);
+}
+
+static void
+pong_cb (EV_P_ ev_async *w, int revents)
+{
+  if (pingpong_done)
+    ev_break (EV_A_ EVBREAK_ALL);
+  else
+    ev_async_send (ping_loop, &ping_w);
+}
+
+static void *
+pong_thread (void *arg)
+{
+  ev_run (pong_loop, 0);
+  return 0;
+}
+
+/* bounce an ev_async between two loops in two threads */
+static void
+bench_async (unsigned int backend)
+{
+  pthread_t tid;
+  ev_tstamp start;
+
+  ping_loop = ev_loop_new (backend);
+  pong_loop = ev_loop_new (backend);
+
+  if (ping_loop && pong_loop)
+    {
+      ev_async_init (&ping_w, ping_cb);
+      ev_async_start (ping_loop, &ping_w);
+      ev_async_init (&pong_w, pong_cb);
+      ev_async_start (pong_loop, &pong_w);
+
+      pingpongs = 0;
+      pingpong_done = 0;
+      pthread_create (&tid, 0, pong_thread, 0);
+
+      start = ev_time ();
+      ev_async_send (pong_loop, &pong_w);
+      ev_run (ping_loop, 0);
+      pthread_join (tid, 0);
+
+      result ("async_latency", backend, PINGPONGS, (ev_time () - start) * 1e9 / (2 * PINGPONGS), "ns/send");
+
+      ev_async_stop (ping_loop, &ping_w);
+      ev_async_stop (pong_loop, &pong_w);
+    }
+
+  if (ping_loop) ev_loop_destroy (ping_loop);
+  if (pong_loop) ev_loop_destroy (pong_loop);
+}
+
+/*****************************************************************************/
+
+#define DISPATCHES 200000
+
+static ev_async *asyncs;
+static int asynccnt;
+static int dispatches;
+
+static void
+dispatch_cb (EV_P_ ev_async *w, int revents)
+{
+  if (++dispatches == DISPATCHES)
+    ev_break (EV_A_ EVBREAK_ALL);
+  else
+    ev_async_send (EV_A_ asyncs + rand () % asynccnt);
+}
+
+/*
+ * how the cost of dispatching an ev_async depends on the number of active
+ * ev_async watchers. each callback sends the next, randomly chosen, watcher,
+ * so every loop iteration dispatches exactly one async event out of asynccnt.
+ */
+static void
+bench_async_dispatch (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (backend);
+  int i;
+
+  if (!loop)
+    return;
+
+  for (asynccnt = 1; asynccnt <= 65536; asynccnt *= 4)
+    {
+      ev_tstamp start;
+
+      asyncs = malloc (sizeof (ev_async) * asynccnt);
+
+      for (i = 0; i < asynccnt; ++i)
+        {
+          ev_async_init (asyncs + i, dispatch_cb);
+          ev_async_start (loop, asyncs + i);
+        }
+
+      dispatches = 0;
+      ev_async_send (loop, asyncs);
+
+      start = ev_time ();
+      ev_run (loop, 0);
+      result ("async_dispatch", backend, asynccnt, (ev_time () - start) * 1e9 / DISPATCHES, "ns/dispatch");
+
+      for (i = 0; i < asynccnt; ++i)
+        ev_async_stop (loop, asyncs + i);
+
+      free (asyncs);
+    }
+
+  ev_loop_destroy (loop);
+}
+
+/*****************************************************************************/
+
+#define FEED_WATCHERS 1000
+#define FEED_ROUNDS   1000
+
+static void
+feed_cb (EV_P_ ev_prepare *w, int revents)
+{
+}
+
+/* feed FEED_WATCHERS (inactive) watchers and invoke them */
+static void
+bench_feed (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (EVFLAG_AUTO);
+  static ev_prepare ws [FEED_WATCHERS];
+  ev_tstamp start;
+  int round, i;
+
+  for (i = 0; i < FEED_WATCHERS; ++i)
+    {
+      ev_prepare_init (ws + i, feed_cb);
+      ev_set_priority (ws + i, i % (EV_MAXPRI - EV_MINPRI + 1) + EV_MINPRI);
+    }
+
+  start = ev_time ();
+  for (round = 0; round < FEED_ROUNDS; ++round)
+    {
+      for (i = 0; i < FEED_WATCHERS; ++i)
+        ev_feed_event (loop, ws + i, EV_CUSTOM);
+
+      ev_invoke_pending (loop);
+    }
+  result ("feed_invoke", 0, FEED_WATCHERS, (ev_time () - start) * 1e9 / (FEED_ROUNDS * FEED_WATCHERS), "ns/event");
+
+  ev_loop_destroy (loop);
+}
+
+/*****************************************************************************/
+
+#define SIGNALS 100000
+
+static int signals;
+
+static void
+signal_cb (EV_P_ ev_signal *w, int revents)
+{
+  if (++signals == SIGNALS)
+    ev_signal_stop (EV_A_ w);
+  else
+    kill (getpid (), SIGUSR1);
+}
+
+/* raise a signal from its own callback, so every iteration delivers one */
+static void
+bench_signal (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (backend);
+  ev_signal w;
+  ev_tstamp start;
+
+  if (!loop)
+    return;
+
+  ev_signal_init (&w, signal_cb, SIGUSR1);
+  ev_signal_start (loop, &w);
+
+  signals = 0;
+
+  start = ev_time ();
+  kill (getpid (), SIGUSR1);
+  ev_run (loop, 0);
+  result ("signal_latency", backend, SIGNALS, (ev_time () - start) * 1e9 / SIGNALS, "ns/signal");
+
+  ev_loop_destroy (loop);
+}
+
+/*****************************************************************************/
+
+#define ONCE_THREADS 4
+#define ONCE_BATCH   1000
+#define ONCE_ROUNDS  500
+
+static void
+once_cb (int revents, void *arg)
+{
+  ++*(int *)arg;
+}
+
+/* many short ev_once timeouts, on a loop per thread. with enough cores, */
+/* more threads should not make a single ev_once slower */
+static void *
+once_thread (void *arg)
+{
+  struct ev_loop *loop = ev_loop_new (EVFLAG_AUTO);
+  int round, i, done = 0;
+
+  for (round = 0; round < ONCE_ROUNDS; ++round)
+    {
+      for (i = 0; i < ONCE_BATCH; ++i)
+        ev_once (loop, -1, 0, 0., once_cb, &done);
+
+      ev_run (loop, EVRUN_NOWAIT);
+    }
+
+  if (done != ONCE_ROUNDS * ONCE_BATCH)
+    abort ();
+
+  ev_loop_destroy (loop);
+  return 0;
+}
+
+static void
+bench_once (unsigned int backend)
+{
+  pthread_t tids [ONCE_THREADS];
+  ev_tstamp start;
+  int threads, i;
+
+  for (threads = 1; threads <= ONCE_THREADS; threads *= 2)
+    {
+      start = ev_time ();
+
+      for (i = 0; i < threads; ++i)
+        pthread_create (tids + i, 0, once_thread, 0);
+
+      for (i = 0; i < threads; ++i)
+        pthread_join (tids [i], 0);
+
+      result ("once", 0, threads, (ev_time () - start) * 1e9 / (threads * ONCE_ROUNDS * ONCE_BATCH), "ns/once");
+    }
+}
+
+/*****************************************************************************/
+
+#define FAIR_HOT  64
+#define FAIR_SPIN 2e-6
+#define FAIR_TIME 0.25
+
+static int fair_counts [FAIR_HOT];
+static int cold_fds [2];
+static ev_tstamp volatile cold_sent;
+static ev_tstamp cold_latency;
+static int cold_events;
+static int volatile cold_done;
+
+/* always readable, never read, and expensive */
+static void
+hot_cb (EV_P_ ev_io *w, int revents)
+{
+  ev_tstamp end = ev_time () + FAIR_SPIN;
+
+  ++fair_counts [(int)(long)w->data];
+
+  while (ev_time () < end)
+    ;
+}
+
+static void
+cold_cb (EV_P_ ev_io *w, int revents)
+{
+  char c;
+
+  if (read (cold_fds [0], &c, 1) == 1)
+    {
+      cold_latency += ev_time () - cold_sent;
+      ++cold_events;
+    }
+}
+
+/* makes the cold fd readable every millisecond, independently of the loop */
+static void *
+cold_thread (void *arg)
+{
+  while (!cold_done)
+    {
+      ev_sleep (1e-3);
+      cold_sent = ev_time ();
+      if (write (cold_fds [1], "", 1) != 1)
+        abort ();
+    }
+
+  return 0;
+}
+
+static void
+fair_stop_cb (EV_P_ ev_timer *w, int revents)
+{
+  ev_break (EV_A_ EVBREAK_ALL);
+}
+
+/*
+ * FAIR_HOT permanently readable fds whose callbacks take FAIR_SPIN each,
+ * plus one high priority cold fd that another thread makes readable every
+ * millisecond, in lifo and fifo order, with and without an invoke budget
+ * in callbacks or time. reports the least served hot fd relative to the
+ * most served one, the mean latency of the cold fd, and how often the
+ * budget was used up per iteration.
+ */
+static void
+bench_fairness (unsigned int backend)
+{
+  static const struct
+  {
+    const char *name;
+    unsigned int flags;
+    unsigned int budget;
+    ev_tstamp time_budget;
+  } modes [] = {
+    { "lifo"    , EVFLAG_AUTO,  0, 0.    },
+    { "lifo_b16", EVFLAG_AUTO, 16, 0.    },
+    { "fifo"    , EVFLAG_FIFO,  0, 0.    },
+    { "fifo_b16", EVFLAG_FIFO, 16, 0.    },
+    { "fifo_t50", EVFLAG_FIFO,  0, 50e-6 },
+  };
+  int hot [FAIR_HOT][2];
+  int m, i;
+
+  for (i = 0; i < FAIR_HOT; ++i)
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, hot [i]) || write (hot [i][1], "", 1) != 1)
+      abort ();
+
+  for (m = 0; m < sizeof (modes) / sizeof (modes [0]); ++m)
+    {
+      struct ev_loop *loop = ev_loop_new (modes [m].flags);
+      static ev_io hot_w [FAIR_HOT];
+      ev_io cold_w;
+      ev_timer stop_timer;
+      pthread_t tid;
+      struct ev_loop_stats stats;
+      int min = -1U >> 1, max = 0;
+      char name [64];
+
+      /* a fresh cold fd, so nothing left over from the last run is pending */
+      if (socketpair (AF_UNIX, SOCK_STREAM, 0, cold_fds))
+        abort ();
+
+      ev_set_invoke_budget (loop, modes [m].budget);
+      ev_set_invoke_time_budget (loop, modes [m].time_budget);
+
+      for (i = 0; i < FAIR_HOT; ++i)
+        {
+          ev_io_init (hot_w + i, hot_cb, hot [i][0], EV_READ);
+          hot_w [i].data = (void *)(long)i;
+          ev_io_start (loop, hot_w + i);
+          fair_counts [i] = 0;
+        }
+
+      ev_io_init (&cold_w, cold_cb, cold_fds [0], EV_READ);
+      ev_set_priority (&cold_w, EV_MAXPRI);
+      ev_io_start (loop, &cold_w);
+      ev_timer_init (&stop_timer, fair_stop_cb, FAIR_TIME, 0.);
+      ev_timer_start (loop, &stop_timer);
+
+      cold_latency = 0.;
+      cold_events = 0;
+      cold_done = 0;
+      pthread_create (&tid, 0, cold_thread, 0);
+
+      ev_run (loop, 0);
+
+      cold_done = 1;
+      pthread_join (tid, 0);
+      ev_loop_stats (loop, &stats);
+
+      for (i = 0; i < FAIR_HOT; ++i)
+        {
+          if (min > fair_counts [i]) min = fair_counts [i];
+          if (max < fair_counts [i]) max = fair_counts [i];
+        }
+
+      sprintf (name, "fairness_%s", modes [m].name);
+      result (name, 0, FAIR_HOT, max ? 100. * min / max : 0., "%min/max");
+      sprintf (name, "cold_latency_%s", modes [m].name);
+      result (name, 0, cold_events, cold_events ? cold_latency * 1e6 / cold_events : 0., "us/event");
+      sprintf (name, "budget_hits_%s", modes [m].name);
+      result (name, 0, ev_iteration (loop), 100. * stats.budget_hits / ev_iteration (loop), "%iterations");
+
+      for (i = 0; i < FAIR_HOT; ++i)
+        ev_io_stop (loop, hot_w + i);
+
+      ev_loop_destroy (loop);
+      close (cold_fds [0]);
+      close (cold_fds [1]);
+    }
+
+  for (i = 0; i < FAIR_HOT; ++i)
+    {
+      close (hot [i][0]);
+      close (hot [i][1]);
+    }
+}
+
+/*****************************************************************************/
+
+#define FDTABLE_FDS    131072
+#define FDTABLE_BATCH  1024
+#define FDTABLE_EVENTS 2000000
+
+static void
+fdtable_cb (EV_P_ ev_io *w, int revents)
+{
+}
+
+/*
+ * feed read events to watchers on FDTABLE_FDS fds, in random and in fd
+ * order, to measure the per-fd state lookup when the fd table is much
+ * larger than the caches. the fds need not be open, as the loop never
+ * polls them.
+ */
+static void
+bench_fdtable (unsigned int backend)
+{
+  struct ev_loop *loop = ev_loop_new (EVFLAG_AUTO);
+  ev_io *ios = malloc (sizeof (ev_io) * FDTABLE_FDS);
+  unsigned int seed = 1;
+  ev_tstamp start;
+  int n, i;
+
+  if (!loop || !ios)
+    return;
+
+  for (i = 0; i < FDTABLE_FDS; ++i)
+    {
+      ev_io_init (ios + i, fdtable_cb, i, EV_READ);
+      ev_io_start (loop, ios + i);
+    }
+
+  start = ev_time ();
+  for (n = 0; n < FDTABLE_EVENTS; n += FDTABLE_BATCH)
+    {
+      for (i = 0; i < FDTABLE_BATCH; ++i)
+        {
+          seed = seed * 1103515245 + 12345;
+          ev_feed_fd_event (loop, (seed >> 8) % FDTABLE_FDS, EV_READ);
+        }
+
+      ev_invoke_pending (loop);
+    }
+  result ("fd_random", 0, FDTABLE_FDS, (ev_time () - start) * 1e9 / FDTABLE_EVENTS, "ns/event");
+
+  start = ev_time ();
+  for (n = 0; n < FDTABLE_EVENTS; n += FDTABLE_BATCH)
+    {
+      for (i = 0; i < FDTABLE_BATCH; ++i)
+        ev_feed_fd_event (loop, (n + i) % FDTABLE_FDS, EV_READ);
+
+      ev_invoke_pending (loop);
+    }
+  result ("fd_sweep", 0, FDTABLE_FDS, (ev_time () - start) * 1e9 / FDTABLE_EVENTS, "ns/event");
+
+  for (i = 0; i < FDTABLE_FDS; ++i)
+    ev_io_stop (loop, ios + i);
+
+  ev_loop_destroy (loop);
+  free (ios);
+}
+
+/*****************************************************************************/
+
+#ifdef __linux__
+
+#define EXCL_ROUNDS 100000
+
+static int excl_events;
+
+static void
+excl_cb (EV_P_ ev_io *w, int revents)
+{
+  ++excl_events;
+}
+
+static void
+excl_stop_cb (EV_P_ ev_timer *w, int revents)
+{
+  ev_break (EV_A_ EVBREAK_ONE);
+}
+
+static void
+excl_break_cb (EV_P_ ev_async *w, int revents)
+{
+  ev_break (EV_A_ EVBREAK_ALL);
+}
+
+static void *
+excl_thread (void *loop)
+{
+  ev_run ((struct ev_loop *)loop, 0);
+
+  return 0;
+}
+
+static void
+excl_fail (const char *what)
+{
+  fprintf (stderr, "exclusive: %s\n", what);
+  exit (1);
+}
+
+/*
+ * checks and times EV_EXCLUSIVE with epoll. another epoll fd stands in
+ * for an fd the kernel refuses EPOLLEXCLUSIVE for: restarting a watcher
+ * on it, with a loop iteration after each stop and start, must not need
+ * any epoll_ctl calls while it is idle, and must not miss events while it
+ * is readable. then two loops watch the same listening socket, and after
+ * the first one stopped its watcher, the second has to see the connection,
+ * even while the first one waits in epoll_wait, so the kernel could pick
+ * it for an exclusive wakeup.
+ */
+static void
+bench_exclusive (unsigned int backend)
+{
+  struct ev_loop *loop, *other;
+  struct epoll_event pev;
+  struct sockaddr_in sa;
+  socklen_t salen = sizeof (sa);
+  int inner, pipefd [2], lfd, cfd;
+  unsigned int elided;
+  ev_io w, ow;
+  ev_async break_w;
+  ev_timer stop_timer;
+  pthread_t tid;
+  ev_tstamp start;
+  int i;
+
+  if (backend != EVBACKEND_EPOLL)
+    return;
+
+  loop = ev_loop_new (backend);
+  inner = epoll_create (1);
+  pev.events = EPOLLIN;
+  pev.data.u64 = 0;
+
+  if (!loop || inner < 0 || pipe (pipefd) || epoll_ctl (inner, EPOLL_CTL_ADD, pipefd [0], &pev))
+    abort ();
+
+  ev_io_init (&w, excl_cb, inner, EV_READ | EV_EXCLUSIVE);
+  ev_io_start (loop, &w);
+  ev_run (loop, EVRUN_NOWAIT);
+
+  elided = ev_fdchange_elided (loop);
+  start = ev_time ();
+  for (i = 0; i < EXCL_ROUNDS; ++i)
+    {
+      ev_io_stop (loop, &w);
+      ev_run (loop, EVRUN_NOWAIT);
+      ev_io_start (loop, &w);
+      ev_run (loop, EVRUN_NOWAIT);
+    }
+  result ("exclusive_refused_idle", backend, EXCL_ROUNDS, (ev_time () - start) * 1e9 / EXCL_ROUNDS, "ns/restart");
+
+  if (ev_fdchange_elided (loop) - elided != 2 * EXCL_ROUNDS)
+    excl_fail ("restarting an idle watcher on an fd without exclusive wakeups called epoll_ctl");
+
+  /* the inner epoll fd stays readable from now on */
+  if (write (pipefd [1], "", 1) != 1)
+    abort ();
+
+  excl_events = 0;
+  start = ev_time ();
+  for (i = 0; i < EXCL_ROUNDS; ++i)
+    {
+      ev_io_stop (loop, &w);
+      ev_run (loop, EVRUN_NOWAIT);
+      ev_io_start (loop, &w);
+      ev_run (loop, EVRUN_NOWAIT);
+    }
+  result ("exclusive_refused_ready", backend, EXCL_ROUNDS, (ev_time () - start) * 1e9 / EXCL_ROUNDS, "ns/restart");
+
+  if (excl_events != EXCL_ROUNDS)
+    excl_fail ("a watcher on an fd without exclusive wakeups missed events");
+
+  if (ev_exclusive_count (loop))
+    excl_fail ("an fd without exclusive wakeups counted as exclusive");
+
+  ev_io_stop (loop, &w);
+  close (inner);
+  close (pipefd [0]);
+  close (pipefd [1]);
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sin_family      = AF_INET;
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  lfd = socket (AF_INET, SOCK_STREAM, 0);
+  cfd = socket (AF_INET, SOCK_STREAM, 0);
+  other = ev_loop_new (backend);
+
+  if (!other || lfd < 0 || cfd < 0
+      || bind (lfd, (struct sockaddr *)&sa, sizeof (sa)) || listen (lfd, 16)
+      || getsockname (lfd, (struct sockaddr *)&sa, &salen))
+    abort ();
+
+  /* the first loop registers first, so the kernel would wake it first */
+  ev_io_init (&w, excl_cb, lfd, EV_READ | EV_EXCLUSIVE);
+  ev_io_start (loop, &w);
+  ev_run (loop, EVRUN_NOWAIT);
+  ev_io_init (&ow, excl_cb, lfd, EV_READ | EV_EXCLUSIVE);
+  ev_io_start (other, &ow);
+  ev_run (other, EVRUN_NOWAIT);
+
+  ev_io_stop (loop, &w);
+  ev_run (loop, EVRUN_NOWAIT);
+
+  ev_async_init (&break_w, excl_break_cb);
+  ev_async_start (loop, &break_w);
+  pthread_create (&tid, 0, excl_thread, loop);
+  ev_sleep (0.05);
+
+  ev_timer_init (&stop_timer, excl_stop_cb, 1., 0.);
+  ev_timer_start (other, &stop_timer);
+
+  excl_events = 0;
+  start = ev_time ();
+  if (connect (cfd, (struct sockaddr *)&sa, salen))
+    abort ();
+
+  ev_run (other, EVRUN_ONCE);
+  result ("exclusive_handoff", backend, 1, (ev_time () - start) * 1e6, "us");
+
+  ev_async_send (loop, &break_w);
+  pthread_join (tid, 0);
+  ev_async_stop (loop, &break_w);
+
+  if (!excl_events)
+    excl_fail ("a loop without watchers for a listening socket took its wakeup");
+
+  ev_timer_stop (other, &stop_timer);
+  ev_io_stop (other, &ow);
+  ev_loop_destroy (other);
+  ev_loop_destroy (loop);
+  close (cfd);
+  close (lfd);
+}
+
+#endif
+
+/*****************************************************************************/
+
+static struct
+{
+  const char *name;
+  void (*run)(unsigned int backend);
+  int per_backend;
+} benchmarks [] = {
+  { "timer"         , bench_timer         , 0 },
+  { "io"            , bench_io            , 1 },
+  { "async"         , bench_async         , 1 },
+  { "async_dispatch", bench_async_dispatch, 1 },
+  { "feed"          , bench_feed          , 0 },
+  { "signal"        , bench_signal        , 1 },
+  { "once"          , bench_once          , 0 },
+  { "fairness"      , bench_fairness      , 0 },
+  { "fdtable"       , bench_fdtable       , 0 },
+#ifdef __linux__
+  { "exclusive"     , bench_exclusive     , 1 },
+#endif
+};
+
+#define NUMBENCH (sizeof (benchmarks) / sizeof (benchmarks [0]))
+
+static void
+run (int i)
+{
+  if (benchmarks [i].per_backend)
+    {
+      unsigned int avail = backends & ev_supported_backends ();
+      unsigned int backend;
+
+      for (backend = 1; backend; backend <<= 1)
+        if (avail & backend)
+          benchmarks [i].run (backend);
+    }
+  else
+    benchmarks [i].run (0);
+}
+
+int
+main (int argc, char *argv [])
+{
+  int c, i, j;
+
+  while ((c = getopt (argc, argv, "b:n:")) != -1)
+    switch (c)
+      {
+        case 'b': backends  = strtoul (optarg, 0, 0); break;
+        case 'n': maxtimers = atoi (optarg); break;
+        default:
+          fprintf (stderr, "usage: %s [-b backends] [-n maxtimers] [benchmark...]\n", argv [0]);
+          return 1;
+      }
+
+  printf ("# libev %d.%d, supported backends 0x%x\n", ev_version_major (), ev_version_minor (), ev_supported_backends ());
+  printf ("# benchmark\tbackend\tn\tvalue\tunit\n");
+
+  if (optind == argc)
+    for (i = 0; i < NUMBENCH; ++i)
+      run (i);
+  else
+    for (j = optind; j < argc; ++j)
+      {
+        for (i = 0; i < NUMBENCH; ++i)
+          if (!strcmp (argv [j], benchmarks [i].name))
+            break;
+
+        if (i == NUMBENCH)
+          {
+            fprintf (stderr, "%s: unknown benchmark\n", argv [j]);
+            return 1;
+          }
+
+        run (i);
+      }
+
+  return 0;
+}
@@ -63,6 +63,8 @@ namespace ev {
     NONE     = EV_NONE,
     READ     = EV_READ,
     WRITE    = EV_WRITE,
+    EXCLUSIVE = EV_EXCLUSIVE,
+    ET       = EV_ET,
 #if EV_COMPAT3
     TIMEOUT  = EV_TIMEOUT,
 #endif
@@ -92,7 +94,8 @@ namespace ev {
     EPOLL     = EVBACKEND_EPOLL,
     KQUEUE    = EVBACKEND_KQUEUE,
     DEVPOLL   = EVBACKEND_DEVPOLL,
-    PORT      = EVBACKEND_PORT
+    PORT      = EVBACKEND_PORT,
+    IOURING   = EVBACKEND_IOURING
   };
 
   enum
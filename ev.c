@@ -107,6 +107,15 @@
 #  undef EV_USE_POLL
 #  define EV_USE_POLL 0
 # endif
+
+# if HAVE_PSELECT
+#  ifndef EV_USE_PSELECT
+#   define EV_USE_PSELECT EV_FEATURE_BACKENDS
+#  endif
+# else
+#  undef EV_USE_PSELECT
+#  define EV_USE_PSELECT 0
+# endif
    
 # if HAVE_EPOLL_CTL && HAVE_SYS_EPOLL_H
 #  ifndef EV_USE_EPOLL
@@ -117,6 +126,15 @@
 #  define EV_USE_EPOLL 0
 # endif
    
+# if HAVE_LINUX_IO_URING_H
+#  ifndef EV_USE_IOURING
+#   define EV_USE_IOURING EV_FEATURE_BACKENDS
+#  endif
+# else
+#  undef EV_USE_IOURING
+#  define EV_USE_IOURING 0
+# endif
+   
 # if HAVE_KQUEUE && HAVE_SYS_EVENT_H
 #  ifndef EV_USE_KQUEUE
 #   define EV_USE_KQUEUE EV_FEATURE_BACKENDS
@@ -292,6 +310,22 @@
 # endif
 #endif
 
+#ifndef EV_USE_PSELECT
+# if !defined(_WIN32) && _POSIX_C_SOURCE >= 200112L
+#  define EV_USE_PSELECT EV_FEATURE_BACKENDS
+# else
+#  define EV_USE_PSELECT 0
+# endif
+#endif
+
+#ifndef EV_USE_PPOLL
+# if __linux
+#  define EV_USE_PPOLL EV_FEATURE_BACKENDS
+# else
+#  define EV_USE_PPOLL 0
+# endif
+#endif
+
 #ifndef EV_USE_EPOLL
 # if __linux && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 4))
 #  define EV_USE_EPOLL EV_FEATURE_BACKENDS
@@ -300,6 +334,10 @@
 # endif
 #endif
 
+#ifndef EV_USE_IOURING
+# define EV_USE_IOURING 0
+#endif
+
 #ifndef EV_USE_KQUEUE
 # define EV_USE_KQUEUE 0
 #endif
@@ -358,6 +396,29 @@
 # define EV_HEAP_CACHE_AT EV_FEATURE_DATA
 #endif
 
+#ifndef EV_HEAP_SOA
+# define EV_HEAP_SOA 0
+#endif
+
+#ifndef EV_USE_TIMER_WHEEL
+# define EV_USE_TIMER_WHEEL 0
+#endif
+
+#ifndef EV_USE_ANFD_PAGES
+# define EV_USE_ANFD_PAGES 0
+#endif
+
+/* the structure-of-arrays heap is a 4-heap with cached at values */
+#if EV_HEAP_SOA
+# undef EV_USE_4HEAP
+# define EV_USE_4HEAP 1
+# undef EV_HEAP_CACHE_AT
+# define EV_HEAP_CACHE_AT 1
+# if defined (__SSE2__) && !EV_USE_NSEC
+#  include <emmintrin.h>
+# endif
+#endif
+
 /* on linux, we can use a (slow) syscall to avoid a dependency on pthread, */
 /* which makes programs even slower. might work on other unices, too. */
 #if EV_USE_CLOCK_SYSCALL
@@ -412,6 +473,25 @@
 # endif
 #endif
 
+#if EV_USE_PPOLL && EV_USE_POLL
+# include <sys/syscall.h>
+/* libc only declares ppoll with _GNU_SOURCE, so we use the syscall */
+# ifndef SYS_ppoll
+#  undef EV_USE_PPOLL
+#  define EV_USE_PPOLL 0
+# endif
+#endif
+
+#if EV_USE_IOURING
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+/* we need a timeout for io_uring_enter, which only exists since linux 5.11 */
+# if !defined(SYS_io_uring_setup) || !defined(IORING_FEAT_EXT_ARG)
+#  undef EV_USE_IOURING
+#  define EV_USE_IOURING 0
+# endif
+#endif
+
 #if EV_SELECT_IS_WINSOCKET
 # include <winsock.h>
 #endif
@@ -472,8 +552,14 @@ struct signalfd_siginfo
 #define MIN_TIMEJUMP  1. /* minimum timejump that gets detected (if monotonic clock available) */
 #define MAX_BLOCKTIME 59.743 /* never wait longer than this time (to detect time jumps) */
 
+#define BUSY_POLL_DEFAULT 5e-5 /* how long EVFLAG_BUSYPOLL spins by default */
+
+#define IO_COLLECT_MIN    5e-5 /* smallest adaptive io collect interval, about the cost of a nanosleep */
+#define IO_COLLECT_EVENTS 16   /* adaptive collecting is done once polls return this many events */
+
 #define EV_TV_SET(tv,t) do { tv.tv_sec = (long)t; tv.tv_usec = (long)((t - tv.tv_sec) * 1e6); } while (0)
 #define EV_TS_SET(ts,t) do { ts.tv_sec = (long)t; ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9); } while (0)
+#define EV_TS_TO_MSEC(t) ((int)((t) * 1e3 + .9999)) /* round up, so we never wake up early */
 
 /* the following is ecb.h embedded into libev - use update_ev_c to update from an external copy */
 /* ECB.H BEGIN */
@@ -947,6 +1033,41 @@ ecb_inline ecb_bool ecb_little_endian (void) { return ecb_byteorder_helper () ==
 # define ECB_MEMORY_FENCE_RELEASE ECB_MEMORY_FENCE
 #endif
 
+/* atomic read-modify-write operations, all imply a full memory fence */
+/* cas returns whether it succeeded, add and and return the old value */
+/* EV_NO_THREADS sets ECB_NO_THREADS, so plain operations are enough */
+#if ECB_NO_THREADS
+# define EV_HAVE_ATOMICS 1
+  ecb_inline unsigned int
+  ev_atomic_and (unsigned int volatile *ptr, unsigned int val)
+  {
+    unsigned int old = *ptr;
+    *ptr = old & val;
+    return old;
+  }
+# define EV_ATOMIC_CAS(ptr,old,new) (*(ptr) == (old) ? (*(ptr) = (new), 1) : 0)
+# define EV_ATOMIC_ADD(ptr,val)     ((*(ptr) += (val)) - (val))
+# define EV_ATOMIC_OR(ptr,val)      (*(ptr) |= (val))
+# define EV_ATOMIC_AND(ptr,val)     ev_atomic_and ((ptr), (val))
+#elif ECB_GCC_VERSION(4,1) || defined(__INTEL_COMPILER) || defined(__clang__)
+# define EV_HAVE_ATOMICS 1
+# define EV_ATOMIC_CAS(ptr,old,new) __sync_bool_compare_and_swap ((ptr), (old), (new))
+# define EV_ATOMIC_ADD(ptr,val)     __sync_fetch_and_add ((ptr), (val))
+# define EV_ATOMIC_OR(ptr,val)      __sync_fetch_and_or ((ptr), (val))
+# define EV_ATOMIC_AND(ptr,val)     __sync_fetch_and_and ((ptr), (val))
+#elif _MSC_VER >= 1400 /* VC++ 2005 */
+# define EV_HAVE_ATOMICS 1
+# pragma intrinsic(_InterlockedCompareExchange,_InterlockedExchangeAdd,_InterlockedOr,_InterlockedAnd)
+# define EV_ATOMIC_CAS(ptr,old,new) (_InterlockedCompareExchange ((long volatile *)(ptr), (long)(new), (long)(old)) == (long)(old))
+# define EV_ATOMIC_ADD(ptr,val)     _InterlockedExchangeAdd ((long volatile *)(ptr), (long)(val))
+# define EV_ATOMIC_OR(ptr,val)      _InterlockedOr ((long volatile *)(ptr), (long)(val))
+# define EV_ATOMIC_AND(ptr,val)     _InterlockedAnd ((long volatile *)(ptr), (long)(val))
+#else
+/* without them, ev_async_send only sets a flag and the loop scans all */
+/* ev_async watchers, and ev_async_queue is not available */
+# define EV_HAVE_ATOMICS 0
+#endif
+
 #define expect_false(cond) ecb_expect_false (cond)
 #define expect_true(cond)  ecb_expect_true  (cond)
 #define noinline           ecb_noinline
@@ -960,6 +1081,11 @@ ecb_inline ecb_bool ecb_little_endian (void) { return ecb_byteorder_helper () ==
 #endif
 
 #define NUMPRI (EV_MAXPRI - EV_MINPRI + 1)
+#define PRIWORDS ((NUMPRI + 31) >> 5) /* size of the priority bitmaps */
+
+#define PRIBIT_SET(bits,pri) ((bits) [(pri) >> 5] |=  (1U << ((pri) & 31)))
+#define PRIBIT_CLR(bits,pri) ((bits) [(pri) >> 5] &= ~(1U << ((pri) & 31)))
+#define PRIBIT_TST(bits,pri) ((bits) [(pri) >> 5] &   (1U << ((pri) & 31)))
 
 #if EV_MINPRI == EV_MAXPRI
 # define ABSPRI(w) (((W)w), 0)
@@ -1158,20 +1284,24 @@ ev_set_allocator (void *(*cb)(void *ptr, long size))
   alloc = cb;
 }
 
+static void noinline ecb_cold
+alloc_failed (long size)
+{
+#if EV_AVOID_STDIO
+  ev_printerr ("(libev) memory allocation failed, aborting.\n");
+#else
+  fprintf (stderr, "(libev) cannot allocate %ld bytes, aborting.", size);
+#endif
+  abort ();
+}
+
 inline_speed void *
 ev_realloc (void *ptr, long size)
 {
   ptr = alloc (ptr, size);
 
   if (!ptr && size)
-    {
-#if EV_AVOID_STDIO
-      ev_printerr ("(libev) memory allocation failed, aborting.\n");
-#else
-      fprintf (stderr, "(libev) cannot allocate %ld bytes, aborting.", size);
-#endif
-      abort ();
-    }
+    alloc_failed (size);
 
   return ptr;
 }
@@ -1184,24 +1314,61 @@ ev_realloc (void *ptr, long size)
 /* set in reify when reification needed */
 #define EV_ANFD_REIFY 1
 
-/* file descriptor info structure */
+/* file descriptor info structure, everything fd_event, fd_reify and */
+/* the backends touch per event. keep it at 16 bytes on 64 bit systems, */
+/* so four of them share a cache line and none straddles two. */
 typedef struct
 {
   WL head;
   unsigned char events; /* the events watched for */
   unsigned char reify;  /* flag set when this ANFD needs reification (EV_ANFD_REIFY, EV__IOFDSET) */
-  unsigned char emask;  /* the epoll backend stores the actual kernel mask in here */
+  unsigned char emask;  /* the epoll and io_uring backends store the actual kernel mask in here */
   unsigned char unused;
-#if EV_USE_EPOLL
+#if EV_USE_EPOLL || EV_USE_IOURING
   unsigned int egen;    /* generation counter to counter epoll bugs */
 #endif
+} ANFD;
+
+/* set in emask when the kernel refused EV_EXCLUSIVE for an fd, which */
+/* is then watched without it, but still counts as matching its events */
+#define EV_EMASK_NOEXCL 0x10
+
+/* per-fd state only needed when an fd changes, kept in a separate array */
 #if EV_SELECT_IS_WINSOCKET || EV_USE_IOCP
+# define EV_ANFD_COLD 1
+typedef struct
+{
   SOCKET handle;
-#endif
 #if EV_USE_IOCP
   OVERLAPPED or, ow;
 #endif
-} ANFD;
+} ANFD_COLD;
+#else
+# define EV_ANFD_COLD 0
+#endif
+
+/* the fd table is either one array, indexed by fd, or, with */
+/* EV_USE_ANFD_PAGES, a directory of pages that only exist where */
+/* fds have been watched. loops over all fds skip missing pages. */
+/* the cold state lives in a parallel array, or behind the ANFDs of a page. */
+#if EV_USE_ANFD_PAGES
+  #define ANFD_PAGE_SHIFT 10
+  #define ANFD_PAGE_MASK  ((1 << ANFD_PAGE_SHIFT) - 1)
+  #define ANFD_AT(fd)      (anfdpages [(fd) >> ANFD_PAGE_SHIFT] + ((fd) & ANFD_PAGE_MASK))
+  #define ANFD_PRESENT(fd) (anfdpages [(fd) >> ANFD_PAGE_SHIFT] != 0) /* fd < anfdmax */
+  #if EV_ANFD_COLD
+    #define ANFD_COLD_AT(fd) ((ANFD_COLD *)(anfdpages [(fd) >> ANFD_PAGE_SHIFT] + ANFD_PAGE_MASK + 1) + ((fd) & ANFD_PAGE_MASK))
+    #define ANFD_PAGE_SIZE   ((sizeof (ANFD) + sizeof (ANFD_COLD)) << ANFD_PAGE_SHIFT)
+  #else
+    #define ANFD_PAGE_SIZE   (sizeof (ANFD) << ANFD_PAGE_SHIFT)
+  #endif
+#else
+  #define ANFD_PAGE_MASK  0
+  #define ANFD_AT(fd)      (anfds + (fd))
+  #define ANFD_PRESENT(fd) 1
+  #define ANFD_COLD_AT(fd) (anfdcolds + (fd))
+#endif
+#define ANFD_VALID(fd) ((fd) < anfdmax && ANFD_PRESENT (fd))
 
 /* stores the pending event set for a given watcher */
 typedef struct
@@ -1210,6 +1377,11 @@ typedef struct
   int events; /* the pending event set for the given watcher */
 } ANPENDING;
 
+/* pending is the index + 1 into pendings, or -(index + 1) into deferreds */
+#define PENDING_ENTRY(w) ((w)->pending > 0 \
+  ? pendings [ABSPRI (w)] + (w)->pending - 1 \
+  : deferreds - (w)->pending - 1)
+
 #if EV_USE_INOTIFY
 /* hash table entry per inotify-id */
 typedef struct
@@ -1219,10 +1391,24 @@ typedef struct
 #endif
 
 /* Heap Entry */
-#if EV_HEAP_CACHE_AT
+#if EV_HEAP_SOA
+  /* four (DHEAP) heap elements, which are the children of one node, */
+  /* with their keys next to each other, so downheap can compare them */
+  /* all at once. element i lives in ANHE i / 4. */
+  typedef struct {
+    ev_time_t at [4];
+    WT w [4];
+  } ANHE;
+
+  #define HEAP_w(heap,i)        (heap) [(unsigned int)(i) >> 2].w  [(i) & 3]
+  #define HEAP_at(heap,i)       (heap) [(unsigned int)(i) >> 2].at [(i) & 3]
+  #define HEAP_at_cache(heap,i) HEAP_at (heap, i) = HEAP_w (heap, i)->at
+  #define HEAP_move(heap,d,s)   HEAP_w (heap, d) = HEAP_w (heap, s), HEAP_at (heap, d) = HEAP_at (heap, s)
+  #define ANHE_NEED(n)          (((n) + 3) >> 2) /* ANHEs needed for n elements */
+#elif EV_HEAP_CACHE_AT
   /* a heap element */
   typedef struct {
-    ev_tstamp at;
+    ev_time_t at;
     WT w;
   } ANHE;
 
@@ -1238,6 +1424,47 @@ typedef struct
   #define ANHE_at_cache(he)
 #endif
 
+#if !EV_HEAP_SOA
+  /* access element i of a heap */
+  #define HEAP_w(heap,i)        ANHE_w ((heap) [i])
+  #define HEAP_at(heap,i)       ANHE_at ((heap) [i])
+  #define HEAP_at_cache(heap,i) ANHE_at_cache ((heap) [i])
+  #define HEAP_move(heap,d,s)   (heap) [d] = (heap) [s]
+  #define ANHE_NEED(n)          (n)
+#endif
+
+#if EV_USE_TIMER_WHEEL
+  /* the timer wheel has TW_LEVELS levels of TW_SLOTS slots each, */
+  /* plus one overflow slot for timers even further away */
+  #define TW_BITS     6
+  #define TW_SLOTS    (1 << TW_BITS)
+  #define TW_MASK     (TW_SLOTS - 1)
+  #define TW_LEVELS   4
+  #define TW_OVERFLOW (TW_LEVELS * TW_SLOTS)
+  #define TW_HZ       1024. /* wheel ticks per second */
+
+  /* a timer wheel node, linked into a slot */
+  typedef struct {
+    WT w;     /* the timer, 0 for free nodes */
+    int next; /* next node in slot, or next free node */
+    int prev; /* previous node in slot, 0 for the first one */
+    int slot;
+  } ANTW;
+#endif
+
+#if EV_ASYNC_ENABLE
+  /* sent ev_async watchers are marked in a two-level bitmap: one bit per */
+  /* watcher index, and one summary bit per 32 watchers. the bitmap is */
+  /* allocated in chunks that never move, as senders access it without locking */
+  #define ASYNC_CHUNKS 64 /* of 1024 watchers each, watchers beyond that are found by scanning */
+  #define ASYNC_CHUNK_BITS 10
+  #if EV_HAVE_ATOMICS
+    #define ASYNC_MAX (ASYNC_CHUNKS << ASYNC_CHUNK_BITS)
+  #else
+    #define ASYNC_MAX 0 /* setting bits needs atomic operations, so scan for all */
+  #endif
+#endif
+
 #if EV_MULTIPLICITY
 
   struct ev_loop
@@ -1265,8 +1492,8 @@ typedef struct
 #endif
 
 #if EV_FEATURE_API
-# define EV_RELEASE_CB if (expect_false (release_cb)) release_cb (EV_A)
-# define EV_ACQUIRE_CB if (expect_false (acquire_cb)) acquire_cb (EV_A)
+# define EV_RELEASE_CB if (expect_false (release_cb) && expect_true (!busy_spinning)) release_cb (EV_A)
+# define EV_ACQUIRE_CB if (expect_false (acquire_cb) && expect_true (!busy_spinning)) acquire_cb (EV_A)
 # define EV_INVOKE_PENDING invoke_cb (EV_A)
 #else
 # define EV_RELEASE_CB (void)0
@@ -1278,6 +1505,29 @@ typedef struct
 
 /*****************************************************************************/
 
+/* memory owned by a loop goes through its own allocator, if it has one */
+inline_speed void *
+loop_realloc (EV_P_ void *ptr, long size)
+{
+  if (size)
+    loop_allocated = 1;
+
+  if (expect_true (!loop_alloc))
+    return ev_realloc (ptr, size);
+
+  ptr = loop_alloc (EV_A_ ptr, size);
+
+  if (!ptr && size)
+    alloc_failed (size);
+
+  return ptr;
+}
+
+#define loop_malloc(size) loop_realloc (EV_A_ 0, (size))
+#define loop_free(ptr)    loop_realloc (EV_A_ (ptr), 0)
+
+/*****************************************************************************/
+
 #ifndef EV_HAVE_EV_TIME
 ev_tstamp
 ev_time (void)
@@ -1297,7 +1547,8 @@ ev_time (void)
 }
 #endif
 
-inline_size ev_tstamp
+/* the monotonic time, in the internal representation */
+inline_size ev_time_t
 get_clock (void)
 {
 #if EV_USE_MONOTONIC
@@ -1305,11 +1556,15 @@ get_clock (void)
     {
       struct timespec ts;
       clock_gettime (CLOCK_MONOTONIC, &ts);
+#if EV_USE_NSEC
+      return ts.tv_sec * (ev_time_t)1000000000 + ts.tv_nsec;
+#else
       return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
     }
 #endif
 
-  return ev_time ();
+  return EV_TIME_FROM_TS (ev_time ());
 }
 
 #if EV_MULTIPLICITY
@@ -1347,6 +1602,7 @@ ev_sleep (ev_tstamp delay)
 /*****************************************************************************/
 
 #define MALLOC_ROUND 4096 /* prefer to allocate in chunks of this size, must be 2**n and >> 4 longs */
+#define SHRINK_INTERVAL 1024 /* default number of loop iterations between attempts to shrink arrays */
 
 /* find a suitable new size for the given array, */
 /* hopefully by rounding to a nice-to-malloc size */
@@ -1372,10 +1628,10 @@ array_nextsize (int elem, int cur, int cnt)
 }
 
 static void * noinline ecb_cold
-array_realloc (int elem, void *base, int *cur, int cnt)
+array_realloc (EV_P_ int elem, void *base, int *cur, int cnt)
 {
   *cur = array_nextsize (elem, *cur, cnt);
-  return ev_realloc (base, elem * *cur);
+  return loop_realloc (EV_A_ base, elem * *cur);
 }
 
 #define array_init_zero(base,count)	\
@@ -1386,22 +1642,37 @@ array_realloc (int elem, void *base, int *cur, int cnt)
     {								\
       int ecb_unused ocur_ = (cur);					\
       (base) = (type *)array_realloc				\
-         (sizeof (type), (base), &(cur), (cnt));		\
+         (EV_A_ sizeof (type), (base), &(cur), (cnt));		\
       init ((base) + (ocur_), (cur) - ocur_);			\
     }
 
-#if 0
-#define array_slim(type,stem)					\
-  if (stem ## max < array_roundsize (stem ## cnt >> 2))		\
-    {								\
-      stem ## max = array_roundsize (stem ## cnt >> 1);		\
-      base = (type *)ev_realloc (base, sizeof (type) * (stem ## max));\
-      fprintf (stderr, "slimmed down " # stem " to %d\n", stem ## max);/*D*/\
-    }
+static void * noinline ecb_cold
+array_shrink (EV_P_ int elem, void *base, int *cur, int cnt)
+{
+  int ncur = array_nextsize (elem, 0, cnt);
+
+  if (ncur >= *cur)
+    return base;
+
+#if EV_FEATURE_API
+  ++loop_stats.shrinks;
+  loop_stats.shrunk += (unsigned long)elem * (*cur - ncur);
 #endif
 
+  *cur = ncur;
+  return loop_realloc (EV_A_ base, elem * ncur);
+}
+
+/* shrink an array that uses less than a quarter of its size, */
+/* unless it is small enough not to matter */
+#define array_slim(type,base,cur,cnt)				\
+  if (expect_false ((cur) > (cnt) * 4				\
+                    && sizeof (type) * (cur) > MALLOC_ROUND))	\
+    (base) = (type *)array_shrink				\
+       (EV_A_ sizeof (type), (base), &(cur), (cnt))
+
 #define array_free(stem, idx) \
-  ev_free (stem ## s idx); stem ## cnt idx = stem ## max idx = 0; stem ## s idx = 0
+  loop_free (stem ## s idx); stem ## cnt idx = stem ## max idx = 0; stem ## s idx = 0
 
 /*****************************************************************************/
 
@@ -1418,14 +1689,51 @@ ev_feed_event (EV_P_ void *w, int revents)
   int pri = ABSPRI (w_);
 
   if (expect_false (w_->pending))
-    pendings [pri][w_->pending - 1].events |= revents;
+    PENDING_ENTRY (w_)->events |= revents;
   else
     {
       w_->pending = ++pendingcnt [pri];
       array_needsize (ANPENDING, pendings [pri], pendingmax [pri], w_->pending, EMPTY2);
       pendings [pri][w_->pending - 1].w      = w_;
       pendings [pri][w_->pending - 1].events = revents;
+
+      if (w_->pending == 1)
+        PRIBIT_SET (pendingbits, pri);
+    }
+}
+
+/* the highest priority set in a priority bitmap, or -1 */
+inline_speed int
+pri_highest (uint32_t *bits)
+{
+  int i;
+
+  for (i = PRIWORDS; i--; )
+    if (bits [i])
+      return (i << 5) + ecb_ld32 (bits [i]);
+
+  return -1;
+}
+
+/* the highest priority below limit set in a priority bitmap, or -1 */
+inline_speed int
+pri_below (uint32_t *bits, int limit)
+{
+  int i = limit >> 5;
+
+  if (limit & 31)
+    {
+      uint32_t below = bits [i] & ((1U << (limit & 31)) - 1);
+
+      if (below)
+        return (i << 5) + ecb_ld32 (below);
     }
+
+  while (i--)
+    if (bits [i])
+      return (i << 5) + ecb_ld32 (bits [i]);
+
+  return -1;
 }
 
 inline_speed void
@@ -1457,7 +1765,7 @@ queue_events (EV_P_ W *events, int eventcnt, int type)
 inline_speed void
 fd_event_nocheck (EV_P_ int fd, int revents)
 {
-  ANFD *anfd = anfds + fd;
+  ANFD *anfd = ANFD_AT (fd);
   ev_io *w;
 
   for (w = (ev_io *)anfd->head; w; w = (ev_io *)((WL)w)->next)
@@ -1474,19 +1782,38 @@ fd_event_nocheck (EV_P_ int fd, int revents)
 inline_speed void
 fd_event (EV_P_ int fd, int revents)
 {
-  ANFD *anfd = anfds + fd;
+  ANFD *anfd = ANFD_AT (fd);
+
+#if EV_FEATURE_API
+  ++loop_stats.poll_events;
+#endif
 
   if (expect_true (!anfd->reify))
     fd_event_nocheck (EV_A_ fd, revents);
+  else if (anfd->events & EV_ET)
+    /* we will not be told again, so make sure the kernel re-checks the fd */
+    anfd->reify |= EV__IOFDSET;
 }
 
 void
 ev_feed_fd_event (EV_P_ int fd, int revents)
 {
-  if (fd >= 0 && fd < anfdmax)
+  if (fd >= 0 && ANFD_VALID (fd))
     fd_event_nocheck (EV_A_ fd, revents);
 }
 
+/* whether the kernel mask the backend stored is what the fd watches for */
+inline_speed int
+anfd_emask_matches (ANFD *anfd)
+{
+  unsigned char events = anfd->events;
+
+  if (expect_false (anfd->emask & EV_EMASK_NOEXCL))
+    events = (events & ~EV_EXCLUSIVE) | EV_EMASK_NOEXCL;
+
+  return anfd->emask == events;
+}
+
 /* make sure the external fd watch events are in-sync */
 /* with the kernel/libev internal state */
 inline_size void
@@ -1494,17 +1821,21 @@ fd_reify (EV_P)
 {
   int i;
 
+#if EV_FEATURE_API
+  loop_stats.fd_changes += fdchangecnt;
+#endif
+
 #if EV_SELECT_IS_WINSOCKET || EV_USE_IOCP
   for (i = 0; i < fdchangecnt; ++i)
     {
       int fd = fdchanges [i];
-      ANFD *anfd = anfds + fd;
+      ANFD *anfd = ANFD_AT (fd);
 
       if (anfd->reify & EV__IOFDSET && anfd->head)
         {
           SOCKET handle = EV_FD_TO_WIN32_HANDLE (fd);
 
-          if (handle != anfd->handle)
+          if (handle != ANFD_COLD_AT (fd)->handle)
             {
               unsigned long arg;
 
@@ -1513,7 +1844,7 @@ fd_reify (EV_P)
               /* handle changed, but fd didn't - we need to do it in two steps */
               backend_modify (EV_A_ fd, anfd->events, 0);
               anfd->events = 0;
-              anfd->handle = handle;
+              ANFD_COLD_AT (fd)->handle = handle;
             }
         }
     }
@@ -1522,7 +1853,7 @@ fd_reify (EV_P)
   for (i = 0; i < fdchangecnt; ++i)
     {
       int fd = fdchanges [i];
-      ANFD *anfd = anfds + fd;
+      ANFD *anfd = ANFD_AT (fd);
       ev_io *w;
 
       unsigned char o_events = anfd->events;
@@ -1532,13 +1863,29 @@ fd_reify (EV_P)
 
       /*if (expect_true (o_reify & EV_ANFD_REIFY)) probably a deoptimisation */
         {
+          unsigned char modes = EV_ET | EV_EXCLUSIVE;
+
           anfd->events = 0;
 
           for (w = (ev_io *)anfd->head; w; w = (ev_io *)((WL)w)->next)
-            anfd->events |= (unsigned char)w->events;
+            {
+              anfd->events |= (unsigned char)w->events;
+              modes &= w->events;
+            }
+
+          /* edge-triggered and exclusive modes are only usable if all watchers want them */
+          anfd->events &= modes | ~(EV_ET | EV_EXCLUSIVE);
 
           if (o_events != anfd->events)
-            o_reify = EV__IOFDSET; /* actually |= */
+            {
+              /* the epoll backend ignores removals, so when the fd is watched */
+              /* again before the kernel told us otherwise, and the fd didn't */
+              /* change, the kernel might still watch exactly what we want */
+              if (!o_events && !(o_reify & EV__IOFDSET) && anfd_emask_matches (anfd))
+                ++fdchange_elided;
+              else
+                o_reify = EV__IOFDSET; /* actually |= */
+            }
         }
 
       if (o_reify & EV__IOFDSET)
@@ -1552,8 +1899,8 @@ fd_reify (EV_P)
 inline_size void
 fd_change (EV_P_ int fd, int flags)
 {
-  unsigned char reify = anfds [fd].reify;
-  anfds [fd].reify |= flags;
+  unsigned char reify = ANFD_AT (fd)->reify;
+  ANFD_AT (fd)->reify |= flags;
 
   if (expect_true (!reify))
     {
@@ -1569,7 +1916,7 @@ fd_kill (EV_P_ int fd)
 {
   ev_io *w;
 
-  while ((w = (ev_io *)anfds [fd].head))
+  while ((w = (ev_io *)ANFD_AT (fd)->head))
     {
       ev_io_stop (EV_A_ w);
       ev_feed_event (EV_A_ (W)w, EV_ERROR | EV_READ | EV_WRITE);
@@ -1594,7 +1941,9 @@ fd_ebadf (EV_P)
   int fd;
 
   for (fd = 0; fd < anfdmax; ++fd)
-    if (anfds [fd].events)
+    if (expect_false (!ANFD_PRESENT (fd)))
+      fd |= ANFD_PAGE_MASK;
+    else if (ANFD_AT (fd)->events)
       if (!fd_valid (fd) && errno == EBADF)
         fd_kill (EV_A_ fd);
 }
@@ -1606,7 +1955,9 @@ fd_enomem (EV_P)
   int fd;
 
   for (fd = anfdmax; fd--; )
-    if (anfds [fd].events)
+    if (expect_false (!ANFD_PRESENT (fd)))
+      fd &= ~ANFD_PAGE_MASK;
+    else if (ANFD_AT (fd)->events)
       {
         fd_kill (EV_A_ fd);
         break;
@@ -1620,12 +1971,22 @@ fd_rearm_all (EV_P)
   int fd;
 
   for (fd = 0; fd < anfdmax; ++fd)
-    if (anfds [fd].events)
-      {
-        anfds [fd].events = 0;
-        anfds [fd].emask  = 0;
-        fd_change (EV_A_ fd, EV__IOFDSET | EV_ANFD_REIFY);
-      }
+    {
+      if (expect_false (!ANFD_PRESENT (fd)))
+        {
+          fd |= ANFD_PAGE_MASK;
+          continue;
+        }
+
+      /* the kernel state is gone, including removals we ignored */
+      ANFD_AT (fd)->emask = 0;
+
+      if (ANFD_AT (fd)->events)
+        {
+          ANFD_AT (fd)->events = 0;
+          fd_change (EV_A_ fd, EV__IOFDSET | EV_ANFD_REIFY);
+        }
+    }
 }
 
 /* used to prepare libev internal fd's */
@@ -1656,7 +2017,106 @@ fd_intern (int fd)
  * which is more cache-efficient.
  * the difference is about 5% with 50000+ watchers.
  */
-#if EV_USE_4HEAP
+#if EV_HEAP_SOA
+
+#define DHEAP 4
+#define HEAP0 (DHEAP - 1) /* index of first element in heap */
+#define HPARENT(k) ((((k) - HEAP0 - 1) / DHEAP) + HEAP0)
+
+/*
+ * with HEAP0 == DHEAP - 1, the children of element k are exactly the
+ * elements of heap [k - HEAP0 + 1], so the smallest of them can be found
+ * with a few compares and no branches.
+ */
+
+/* index of the smallest of DHEAP keys, the first one on ties */
+inline_speed int
+heap_minchild (const ev_time_t *at)
+{
+#if defined (__SSE2__) && !EV_USE_NSEC
+  __m128d a = _mm_loadu_pd (at + 0);
+  __m128d b = _mm_loadu_pd (at + 2);
+  __m128d m = _mm_min_pd (a, b);
+
+  m = _mm_min_pd (m, _mm_shuffle_pd (m, m, 1));
+
+  return ecb_ctz32 (_mm_movemask_pd (_mm_cmpeq_pd (a, m))
+                  | _mm_movemask_pd (_mm_cmpeq_pd (b, m)) << 2);
+#else
+  int i = at [1] < at [0];
+  int j = 2 + (at [3] < at [2]);
+
+  return at [j] < at [i] ? j : i;
+#endif
+}
+
+/* away from the root */
+inline_speed void
+downheap (ANHE *heap, int N, int k)
+{
+  WT w = HEAP_w (heap, k);
+  ev_time_t at = HEAP_at (heap, k);
+  int E = N + HEAP0;
+
+  for (;;)
+    {
+      ANHE *children = heap + k - HEAP0 + 1;
+      int c = DHEAP * (k - HEAP0) + HEAP0 + 1;
+      int min;
+
+      if (expect_true (c + DHEAP - 1 < E))
+        min = heap_minchild (children->at);
+      else if (c < E)
+        {
+          int i;
+
+          for (min = 0, i = 1; c + i < E; ++i)
+            if (children->at [i] < children->at [min])
+              min = i;
+        }
+      else
+        break;
+
+      if (at <= children->at [min])
+        break;
+
+      HEAP_w  (heap, k) = children->w  [min];
+      HEAP_at (heap, k) = children->at [min];
+      ev_active (HEAP_w (heap, k)) = k;
+
+      k = c + min;
+    }
+
+  HEAP_w  (heap, k) = w;
+  HEAP_at (heap, k) = at;
+  ev_active (w) = k;
+}
+
+/* towards the root */
+inline_speed void
+upheap (ANHE *heap, int k)
+{
+  WT w = HEAP_w (heap, k);
+  ev_time_t at = HEAP_at (heap, k);
+
+  while (k > HEAP0)
+    {
+      int p = HPARENT (k);
+
+      if (HEAP_at (heap, p) <= at)
+        break;
+
+      HEAP_move (heap, k, p);
+      ev_active (HEAP_w (heap, k)) = k;
+      k = p;
+    }
+
+  HEAP_w  (heap, k) = w;
+  HEAP_at (heap, k) = at;
+  ev_active (w) = k;
+}
+
+#elif EV_USE_4HEAP
 
 #define DHEAP 4
 #define HEAP0 (DHEAP - 1) /* index of first element in heap */
@@ -1672,7 +2132,7 @@ downheap (ANHE *heap, int N, int k)
 
   for (;;)
     {
-      ev_tstamp minat;
+      ev_time_t minat;
       ANHE *minpos;
       ANHE *pos = heap + DHEAP * (k - HEAP0) + HEAP0 + 1;
 
@@ -1743,6 +2203,7 @@ downheap (ANHE *heap, int N, int k)
 }
 #endif
 
+#if !EV_HEAP_SOA
 /* towards the root */
 inline_speed void
 upheap (ANHE *heap, int k)
@@ -1764,12 +2225,13 @@ upheap (ANHE *heap, int k)
   heap [k] = he;
   ev_active (ANHE_w (he)) = k;
 }
+#endif
 
 /* move an element suitably so it is in a correct place */
 inline_size void
 adjustheap (ANHE *heap, int N, int k)
 {
-  if (k > HEAP0 && ANHE_at (heap [k]) <= ANHE_at (heap [HPARENT (k)]))
+  if (k > HEAP0 && HEAP_at (heap, k) <= HEAP_at (heap, HPARENT (k)))
     upheap (heap, k);
   else
     downheap (heap, N, k);
@@ -1789,43 +2251,317 @@ reheap (ANHE *heap, int N)
 
 /*****************************************************************************/
 
-/* associate signal watchers to a signal signal */
-typedef struct
+#if EV_USE_TIMER_WHEEL
+/*
+ * with the timer wheel, timers that are due in a later wheel tick are not
+ * kept in the timer heap but in a hierarchical timer wheel, where they can
+ * be started, stopped and moved in O(1). only when their tick comes up, they
+ * are moved into the heap, which still takes care of exact expiry and
+ * ordering. since most timeouts (think idle connection timeouts) are stopped
+ * or moved long before they expire, the heap stays small.
+ *
+ * a timer lives on the level given by the most significant TW_BITS digit
+ * in which its tick differs from twtick, in the slot given by its digit on
+ * that level. when twtick advances, the slots that come up are either moved
+ * to the heap or cascaded down to lower levels.
+ *
+ * wheel timers have a negative ev_active, which is minus their node index.
+ */
+
+inline_speed uint64_t
+tw_tick (ev_time_t at)
 {
-  EV_ATOMIC_T pending;
-#if EV_MULTIPLICITY
-  EV_P;
-#endif
-  WL head;
-} ANSIG;
+  return at > 0 ? (uint64_t)(EV_TIME_TO_TS (at) * TW_HZ) : 0;
+}
 
-static ANSIG signals [EV_NSIG - 1];
+inline_size void
+timer_heap_insert (EV_P_ ev_timer *w)
+{
+  ++timercnt;
+  ev_active (w) = timercnt + HEAP0 - 1;
+  array_needsize (ANHE, timers, timermax, ANHE_NEED (ev_active (w) + 1), EMPTY2);
+  HEAP_w (timers, ev_active (w)) = (WT)w;
+  HEAP_at_cache (timers, ev_active (w));
+  upheap (timers, ev_active (w));
+}
 
-/*****************************************************************************/
+inline_size void
+timer_heap_remove (EV_P_ int active)
+{
+  --timercnt;
 
-#if EV_SIGNAL_ENABLE || EV_ASYNC_ENABLE
+  if (expect_true (active < timercnt + HEAP0))
+    {
+      HEAP_move (timers, active, timercnt + HEAP0);
+      adjustheap (timers, timercnt, active);
+    }
+}
 
-static void noinline ecb_cold
-evpipe_init (EV_P)
+/* link a node into the slot its timer belongs to, must be after twtick */
+static void
+tw_link (EV_P_ int n)
 {
-  if (!ev_is_active (&pipe_w))
+  ANTW *node = twnodes + n;
+  uint64_t tick = tw_tick (node->w->at);
+  uint64_t diff = tick ^ twtick;
+
+  if (expect_false (diff >> (TW_BITS * TW_LEVELS)))
+    node->slot = TW_OVERFLOW;
+  else
     {
-# if EV_USE_EVENTFD
-      evfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
-      if (evfd < 0 && errno == EINVAL)
-        evfd = eventfd (0, 0);
+      int level = ecb_ld64 (diff) / TW_BITS;
+      int idx   = (tick >> (level * TW_BITS)) & TW_MASK;
 
-      if (evfd >= 0)
-        {
-          evpipe [0] = -1;
-          fd_intern (evfd); /* doing it twice doesn't hurt */
-          ev_io_set (&pipe_w, evfd, EV_READ);
-        }
-      else
-# endif
-        {
-          while (pipe (evpipe))
-            ev_syserr ("(libev) error creating signal/async pipe");
+      twbits [level] |= (uint64_t)1 << idx;
+      node->slot = level * TW_SLOTS + idx;
+    }
+
+  node->prev = 0;
+  node->next = twslots [node->slot];
+
+  if (node->next)
+    twnodes [node->next].prev = n;
+
+  twslots [node->slot] = n;
+}
+
+static void
+tw_unlink (EV_P_ int n)
+{
+  ANTW *node = twnodes + n;
+
+  if (node->next)
+    twnodes [node->next].prev = node->prev;
+
+  if (node->prev)
+    twnodes [node->prev].next = node->next;
+  else if (!(twslots [node->slot] = node->next) && node->slot < TW_OVERFLOW)
+    twbits [node->slot >> TW_BITS] &= ~((uint64_t)1 << (node->slot & TW_MASK));
+}
+
+inline_size void
+tw_insert (EV_P_ ev_timer *w)
+{
+  int n = twfree;
+
+  if (n)
+    twfree = twnodes [n].next;
+  else
+    {
+      n = ++twnodecnt;
+      array_needsize (ANTW, twnodes, twnodemax, n + 1, EMPTY2);
+    }
+
+  ++twcnt;
+  twnodes [n].w = (WT)w;
+  ev_active (w) = -n;
+  tw_link (EV_A_ n);
+}
+
+/* free a node that is no longer linked */
+inline_size void
+tw_free (EV_P_ int n)
+{
+  --twcnt;
+  twnodes [n].w    = 0;
+  twnodes [n].next = twfree;
+  twfree = n;
+}
+
+/* put an active timer into the right place after its at changed */
+inline_size void
+timer_move (EV_P_ ev_timer *w)
+{
+  int active = ev_active (w);
+  int far = tw_tick (ev_at (w)) > twtick;
+
+  if (active < 0)
+    {
+      tw_unlink (EV_A_ -active);
+
+      if (far)
+        tw_link (EV_A_ -active);
+      else
+        {
+          tw_free (EV_A_ -active);
+          timer_heap_insert (EV_A_ w);
+        }
+    }
+  else if (far)
+    {
+      timer_heap_remove (EV_A_ active);
+      tw_insert (EV_A_ w);
+    }
+  else
+    {
+      HEAP_at_cache (timers, active);
+      adjustheap (timers, timercnt, active);
+    }
+}
+
+/* re-sort all timers of a slot relative to the current twtick */
+static void
+tw_requeue_slot (EV_P_ int slot)
+{
+  int n = twslots [slot];
+
+  twslots [slot] = 0;
+  if (slot < TW_OVERFLOW)
+    twbits [slot >> TW_BITS] &= ~((uint64_t)1 << (slot & TW_MASK));
+
+  while (n)
+    {
+      int next = twnodes [n].next;
+      ev_timer *w = (ev_timer *)twnodes [n].w;
+
+      if (tw_tick (ev_at (w)) > twtick)
+        tw_link (EV_A_ n);
+      else
+        {
+          tw_free (EV_A_ n);
+          timer_heap_insert (EV_A_ w);
+        }
+
+      n = next;
+    }
+}
+
+/* requeue all slots on a level whose bit is in mask */
+inline_size void
+tw_requeue_level (EV_P_ int level, uint64_t mask)
+{
+  uint64_t bits = twbits [level] & mask;
+
+  while (bits)
+    {
+      tw_requeue_slot (EV_A_ level * TW_SLOTS + ecb_ctz64 (bits));
+      bits &= bits - 1;
+    }
+}
+
+/* advance twtick to the next tick after mn_now, which moves all timers */
+/* that might expire before then into the heap */
+static void
+tw_advance (EV_P)
+{
+  uint64_t otick = twtick;
+  uint64_t diff;
+  int top, level;
+
+  twtick = tw_tick (mn_now) + 1;
+
+  if (expect_true (twtick <= otick))
+    {
+      twtick = otick;
+      return;
+    }
+
+  diff = twtick ^ otick;
+  top  = ecb_ld64 (diff) / TW_BITS;
+
+  /* timers below the highest changed digit are all due now */
+  for (level = 0; level < top && level < TW_LEVELS; ++level)
+    if (twbits [level])
+      tw_requeue_level (EV_A_ level, ~(uint64_t)0);
+
+  if (top < TW_LEVELS)
+    {
+      /* on the top level, all slots up to the new digit are due, */
+      /* and the slot with the new digit needs to be cascaded */
+      int odigit = (otick  >> (top * TW_BITS)) & TW_MASK;
+      int ndigit = (twtick >> (top * TW_BITS)) & TW_MASK;
+
+      tw_requeue_level (EV_A_ top, ((uint64_t)2 << ndigit) - ((uint64_t)2 << odigit));
+    }
+  else if (twslots [TW_OVERFLOW])
+    tw_requeue_slot (EV_A_ TW_OVERFLOW);
+}
+
+/* the earliest tick any timer in the wheel could be due in */
+inline_size uint64_t
+tw_next (EV_P)
+{
+  int level;
+
+  for (level = 0; level < TW_LEVELS; ++level)
+    if (twbits [level])
+      {
+        int shift = level * TW_BITS;
+
+        return (twtick >> shift >> TW_BITS << TW_BITS | ecb_ctz64 (twbits [level])) << shift;
+      }
+
+  return ((twtick >> (TW_BITS * TW_LEVELS)) + 1) << (TW_BITS * TW_LEVELS);
+}
+
+/* rebuild the wheel after all timers have been shifted by adjust */
+static void noinline ecb_cold
+tw_reschedule (EV_P_ ev_time_t adjust)
+{
+  int n;
+
+  twtick = tw_tick (EV_TIME_FROM_TS (twtick / TW_HZ) + adjust);
+
+  memset (twbits , 0, sizeof (twbits ));
+  memset (twslots, 0, sizeof (twslots));
+
+  for (n = 1; n <= twnodecnt; ++n)
+    if (twnodes [n].w)
+      {
+        ev_timer *w = (ev_timer *)twnodes [n].w;
+
+        ev_at (w) += adjust;
+
+        if (tw_tick (ev_at (w)) > twtick)
+          tw_link (EV_A_ n);
+        else
+          {
+            tw_free (EV_A_ n);
+            timer_heap_insert (EV_A_ w);
+          }
+      }
+}
+#endif
+
+/*****************************************************************************/
+
+/* associate signal watchers to a signal signal */
+typedef struct
+{
+  EV_ATOMIC_T pending;
+#if EV_MULTIPLICITY
+  EV_P;
+#endif
+  WL head;
+} ANSIG;
+
+static ANSIG signals [EV_NSIG - 1];
+
+/*****************************************************************************/
+
+#if EV_SIGNAL_ENABLE || EV_ASYNC_ENABLE
+
+static void noinline ecb_cold
+evpipe_init (EV_P)
+{
+  if (!ev_is_active (&pipe_w))
+    {
+# if EV_USE_EVENTFD
+      evfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (evfd < 0 && errno == EINVAL)
+        evfd = eventfd (0, 0);
+
+      if (evfd >= 0)
+        {
+          evpipe [0] = -1;
+          fd_intern (evfd); /* doing it twice doesn't hurt */
+          ev_io_set (&pipe_w, evfd, EV_READ);
+        }
+      else
+# endif
+        {
+          while (pipe (evpipe))
+            ev_syserr ("(libev) error creating signal/async pipe");
 
           fd_intern (evpipe [0]);
           fd_intern (evpipe [1]);
@@ -1920,14 +2656,54 @@ pipecb (EV_P_ ev_io *iow, int revents)
 #if EV_ASYNC_ENABLE
   if (async_pending)
     {
+#if EV_HAVE_ATOMICS
+      int chunk;
+#endif
+
       async_pending = 0;
 
-      for (i = asynccnt; i--; )
-        if (asyncs [i]->sent)
+      ECB_MEMORY_FENCE; /* make sure async_pending is reset before we look at the bitmap */
+
+#if EV_HAVE_ATOMICS
+      for (chunk = 0; chunk < asyncchunks; ++chunk)
+        if (asyncsum [chunk])
           {
-            asyncs [i]->sent = 0;
-            ev_feed_event (EV_A_ asyncs [i], EV_ASYNC);
+            unsigned int sum = EV_ATOMIC_AND (&asyncsum [chunk], 0);
+
+            while (sum)
+              {
+                int word = ecb_ctz32 (sum);
+                unsigned int bits = EV_ATOMIC_AND (&asyncbits [chunk][word], 0);
+
+                sum &= sum - 1;
+
+                while (bits)
+                  {
+                    /* the index might be stale when the watcher moved, so check sent */
+                    i = (chunk << ASYNC_CHUNK_BITS) | (word << 5) | ecb_ctz32 (bits);
+                    bits &= bits - 1;
+
+                    if (i < asynccnt && asyncs [i]->sent)
+                      {
+                        asyncs [i]->sent = 0;
+                        ev_feed_event (EV_A_ asyncs [i], EV_ASYNC);
+                      }
+                  }
+              }
           }
+#endif
+
+      if (expect_false (async_overflow))
+        {
+          async_overflow = 0;
+
+          for (i = asynccnt; i-- > ASYNC_MAX; )
+            if (asyncs [i]->sent)
+              {
+                asyncs [i]->sent = 0;
+                ev_feed_event (EV_A_ asyncs [i], EV_ASYNC);
+              }
+        }
     }
 #endif
 }
@@ -2077,6 +2853,9 @@ childcb (EV_P_ ev_signal *sw, int revents)
 #if EV_USE_KQUEUE
 # include "ev_kqueue.c"
 #endif
+#if EV_USE_IOURING
+# include "ev_iouring.c"
+#endif
 #if EV_USE_EPOLL
 # include "ev_epoll.c"
 #endif
@@ -2119,6 +2898,7 @@ ev_supported_backends (void)
   if (EV_USE_PORT  ) flags |= EVBACKEND_PORT;
   if (EV_USE_KQUEUE) flags |= EVBACKEND_KQUEUE;
   if (EV_USE_EPOLL ) flags |= EVBACKEND_EPOLL;
+  if (EV_USE_IOURING) flags |= EVBACKEND_IOURING;
   if (EV_USE_POLL  ) flags |= EVBACKEND_POLL;
   if (EV_USE_SELECT) flags |= EVBACKEND_SELECT;
   
@@ -2144,6 +2924,11 @@ ev_recommended_backends (void)
   flags &= ~EVBACKEND_POLL;   /* poll return value is unusable (http://forums.freebsd.org/archive/index.php/t-10270.html) */
 #endif
 
+  /* io_uring is still young, and often disabled by seccomp filters or sysctls, */
+  /* so it has to be asked for explicitly. loop_init prefers it over epoll, */
+  /* and falls back to epoll when the kernel is too old or refuses. */
+  flags &= ~EVBACKEND_IOURING;
+
   return flags;
 }
 
@@ -2166,6 +2951,20 @@ ev_backend (EV_P)
 }
 
 #if EV_FEATURE_API
+/* the log2 histogram bucket for a count */
+inline_speed int
+stats_bucket (unsigned long n)
+{
+  return n ? ecb_ld32 ((uint32_t)(n < 0x7fffffffUL ? n : 0x7fffffffUL)) + 1 : 0;
+}
+
+/* the log2 histogram bucket for a duration, in microseconds */
+inline_speed int
+stats_time_bucket (ev_tstamp t)
+{
+  return t >= 1e-6 ? stats_bucket (t < 2147483647e-6 ? (unsigned long)(t * 1e6) : 0x7fffffffUL) : 0;
+}
+
 unsigned int
 ev_iteration (EV_P)
 {
@@ -2178,10 +2977,120 @@ ev_depth (EV_P)
   return loop_depth;
 }
 
+unsigned int
+ev_fdchange_elided (EV_P)
+{
+  return fdchange_elided;
+}
+
+unsigned int
+ev_exclusive_count (EV_P)
+{
+  return exclusive_count;
+}
+
+void
+ev_loop_stats (EV_P_ struct ev_loop_stats *stats)
+{
+  *stats = loop_stats;
+}
+
+void
+ev_loop_stats_reset (EV_P)
+{
+  memset (&loop_stats, 0, sizeof (loop_stats));
+}
+
+void
+ev_loop_stats_timing (EV_P_ int enable)
+{
+  loop_stats_timing = !!enable;
+}
+
+void
+ev_loop_stats_callbacks (EV_P_ int enable)
+{
+  loop_stats_cbs = !!enable;
+  cb_timing = loop_stats_cbs || slow_cb;
+}
+
+void
+ev_set_slow_cb (EV_P_ ev_tstamp threshold, void (*cb)(EV_P_ void *w, int revents, ev_tstamp elapsed))
+{
+  slow_threshold = threshold;
+  slow_cb        = cb;
+  cb_timing      = loop_stats_cbs || slow_cb;
+}
+
 void
 ev_set_io_collect_interval (EV_P_ ev_tstamp interval)
 {
-  io_blocktime = interval;
+  io_blocktime   = interval;
+  io_collect_max = 0.;
+}
+
+void
+ev_set_loop_allocator (EV_P_ void *(*cb)(EV_P_ void *ptr, long size))
+{
+  assert (("libev: ev_set_loop_allocator called after the loop allocated memory", !loop_allocated));
+  loop_alloc = cb;
+}
+
+void
+ev_set_shrink_interval (EV_P_ unsigned int iterations)
+{
+  shrink_interval  = iterations;
+  shrink_countdown = iterations;
+}
+
+void
+ev_set_invoke_budget (EV_P_ unsigned int callbacks)
+{
+  invoke_budget = callbacks;
+}
+
+void
+ev_set_invoke_time_budget (EV_P_ ev_tstamp interval)
+{
+  invoke_time_budget = interval > 0. ? EV_TIME_FROM_TS (interval) : 0;
+
+  /* intervals below the clock resolution must not disable the limit */
+  if (interval > 0. && invoke_time_budget <= 0)
+    invoke_time_budget = 1;
+}
+
+void
+ev_set_busy_poll (EV_P_ ev_tstamp spin)
+{
+  busy_poll = spin;
+}
+
+void
+ev_set_io_collect_adaptive (EV_P_ ev_tstamp max)
+{
+  io_blocktime   = 0.;
+  io_collect_max = max;
+}
+
+/*
+ * adapt io_blocktime to the load of the last iteration: while the loop
+ * spends more time working than waiting and polls return only a few
+ * events each, we collect events for longer before polling again. as
+ * soon as the loop waits more than it works, we quickly go back to not
+ * delaying at all, as collecting would only add latency then.
+ */
+inline_size void
+io_collect_adapt (EV_P_ ev_tstamp busy, ev_tstamp idle, unsigned long events)
+{
+  if (idle >= busy)
+    io_blocktime = io_blocktime > IO_COLLECT_MIN * 2. ? io_blocktime * .5 : 0.;
+  else if (events < IO_COLLECT_EVENTS)
+    {
+      io_blocktime = io_blocktime >= IO_COLLECT_MIN ? io_blocktime * 1.25 : IO_COLLECT_MIN;
+
+      if (io_blocktime > io_collect_max)
+        io_blocktime = io_collect_max;
+    }
 }
 
 void
@@ -2190,6 +3099,13 @@ ev_set_timeout_collect_interval (EV_P_ ev_tstamp interval)
   timeout_blocktime = interval;
 }
 
+void
+ev_set_timer_slack (EV_P_ ev_tstamp fraction, ev_tstamp max)
+{
+  timer_slack     = fraction;
+  timer_slack_max = max < 4000. ? max : 4000.; /* keeps the grid within 32 bits */
+}
+
 void
 ev_set_userdata (EV_P_ void *data)
 {
@@ -2258,13 +3174,27 @@ loop_init (EV_P_ unsigned int flags)
       ev_rt_now          = ev_time ();
       mn_now             = get_clock ();
       now_floor          = mn_now;
-      rtmn_diff          = ev_rt_now - mn_now;
+      rtmn_diff          = EV_TIME_FROM_TS (ev_rt_now) - mn_now;
+#if EV_USE_TIMER_WHEEL
+      twtick             = tw_tick (mn_now);
+#endif
 #if EV_FEATURE_API
       invoke_cb          = ev_invoke_pending;
+      busy_poll          = flags & EVFLAG_BUSYPOLL ? BUSY_POLL_DEFAULT : 0.;
+      busy_spinning      = 0;
 #endif
 
       io_blocktime       = 0.;
       timeout_blocktime  = 0.;
+      pending_fifo       = !!(flags & EVFLAG_FIFO);
+      invoke_budget      = 0;
+      invoke_time_budget = 0;
+      loop_alloc         = 0;
+      loop_allocated     = 0;
+      shrink_interval    = SHRINK_INTERVAL;
+      shrink_countdown   = SHRINK_INTERVAL;
+      timer_slack        = 0.;
+      timer_slack_max    = 0.;
       backend            = 0;
       backend_fd         = -1;
       sig_pending        = 0;
@@ -2292,6 +3222,9 @@ loop_init (EV_P_ unsigned int flags)
 #if EV_USE_KQUEUE
       if (!backend && (flags & EVBACKEND_KQUEUE)) backend = kqueue_init (EV_A_ flags);
 #endif
+#if EV_USE_IOURING
+      if (!backend && (flags & EVBACKEND_IOURING)) backend = iouring_init (EV_A_ flags);
+#endif
 #if EV_USE_EPOLL
       if (!backend && (flags & EVBACKEND_EPOLL )) backend = epoll_init  (EV_A_ flags);
 #endif
@@ -2311,6 +3244,8 @@ loop_init (EV_P_ unsigned int flags)
     }
 }
 
+static void once_destroy (EV_P);
+
 /* free up a loop structure */
 void ecb_cold
 ev_loop_destroy (EV_P)
@@ -2379,6 +3314,9 @@ ev_loop_destroy (EV_P)
 #if EV_USE_KQUEUE
   if (backend == EVBACKEND_KQUEUE) kqueue_destroy (EV_A);
 #endif
+#if EV_USE_IOURING
+  if (backend == EVBACKEND_IOURING) iouring_destroy (EV_A);
+#endif
 #if EV_USE_EPOLL
   if (backend == EVBACKEND_EPOLL ) epoll_destroy  (EV_A);
 #endif
@@ -2397,12 +3335,31 @@ ev_loop_destroy (EV_P)
 #endif
     }
 
-  ev_free (anfds); anfds = 0; anfdmax = 0;
+  memset (pendingbits, 0, sizeof (pendingbits));
+#if EV_IDLE_ENABLE
+  memset (idlebits, 0, sizeof (idlebits));
+#endif
+
+#if EV_USE_ANFD_PAGES
+  for (i = 0; i < anfdpagemax; ++i)
+    loop_free (anfdpages [i]);
+
+  loop_free (anfdpages); anfdpages = 0; anfdpagemax = 0; anfdmax = 0;
+#else
+  loop_free (anfds); anfds = 0; anfdmax = 0;
+#if EV_ANFD_COLD
+  loop_free (anfdcolds); anfdcolds = 0; anfdcoldmax = 0;
+#endif
+#endif
 
   /* have to use the microsoft-never-gets-it-right macro */
   array_free (rfeed, EMPTY);
+  array_free (deferred, EMPTY);
   array_free (fdchange, EMPTY);
   array_free (timer, EMPTY);
+#if EV_USE_TIMER_WHEEL
+  array_free (twnode, EMPTY);
+#endif
 #if EV_PERIODIC_ENABLE
   array_free (periodic, EMPTY);
 #endif
@@ -2416,8 +3373,13 @@ ev_loop_destroy (EV_P)
   array_free (check, EMPTY);
 #if EV_ASYNC_ENABLE
   array_free (async, EMPTY);
+
+  while (asyncchunks)
+    loop_free ((void *)asyncbits [--asyncchunks]);
 #endif
 
+  once_destroy (EV_A);
+
   backend = 0;
 
 #if EV_MULTIPLICITY
@@ -2430,6 +3392,119 @@ ev_loop_destroy (EV_P)
 #endif
 }
 
+#if EV_USE_ANFD_PAGES
+/* anfdmax covers all fds the directory could hold */
+inline_size void
+anfd_page_max (EV_P)
+{
+  anfdmax = anfdpagemax > (INT_MAX >> ANFD_PAGE_SHIFT)
+          ? INT_MAX : anfdpagemax << ANFD_PAGE_SHIFT;
+}
+
+/* make sure the page holding fd exists, a missing page means no fd in it */
+/* was ever watched, or all of them were given back by loop_shrink */
+inline_speed void
+anfd_page_need (EV_P_ int fd)
+{
+  int page = fd >> ANFD_PAGE_SHIFT;
+
+  if (expect_false (page >= anfdpagemax))
+    {
+      array_needsize (ANFD *, anfdpages, anfdpagemax, page + 1, array_init_zero);
+      anfd_page_max (EV_A);
+    }
+
+  if (expect_false (!anfdpages [page]))
+    {
+      anfdpages [page] = (ANFD *)loop_malloc (ANFD_PAGE_SIZE);
+      memset (anfdpages [page], 0, ANFD_PAGE_SIZE);
+    }
+}
+#endif
+
+/* whether neither we nor the backend need an fd's ANFD entry anymore */
+inline_size int
+anfd_unused (EV_P_ int fd)
+{
+  ANFD *anfd = ANFD_AT (fd);
+
+  if (anfd->head || anfd->events || anfd->reify)
+    return 0;
+
+#if EV_USE_EPOLL
+  /* epoll ignores removals, so the kernel might still watch the fd */
+  if (anfd->emask && backend == EVBACKEND_EPOLL)
+    return epoll_forget (EV_A_ fd);
+#endif
+
+  return !anfd->emask;
+}
+
+/* give memory back after a load spike, see ev_set_shrink_interval */
+static void noinline ecb_cold
+loop_shrink (EV_P)
+{
+  /* the transient arrays are mostly empty between iterations, so */
+  /* they get to keep room for one event per active watcher */
+  int keep = activecnt;
+  int i;
+
+  shrink_countdown = shrink_interval;
+
+  for (i = NUMPRI; i--; )
+    array_slim (ANPENDING, pendings [i], pendingmax [i], pendingcnt [i] > keep ? pendingcnt [i] : keep);
+
+  array_slim (ANPENDING, deferreds, deferredmax, deferredcnt > keep ? deferredcnt : keep);
+  array_slim (int, fdchanges, fdchangemax, fdchangecnt > keep ? fdchangecnt : keep);
+  array_slim (W, rfeeds, rfeedmax, rfeedcnt > keep ? rfeedcnt : keep);
+
+  array_slim (ANHE, timers, timermax, ANHE_NEED (timercnt + HEAP0));
+#if EV_PERIODIC_ENABLE
+  array_slim (ANHE, periodics, periodicmax, ANHE_NEED (periodiccnt + HEAP0));
+#endif
+
+  /* io_uring might still complete polls we removed, for any fd */
+#if EV_USE_IOURING
+  if (backend != EVBACKEND_IOURING)
+#endif
+    {
+#if EV_USE_ANFD_PAGES
+      int used = 0;
+
+      for (i = 0; i < anfdpagemax; ++i)
+        if (anfdpages [i])
+          {
+            int fd = i << ANFD_PAGE_SHIFT;
+            int end = fd + ANFD_PAGE_MASK + 1;
+
+            while (fd < end && anfd_unused (EV_A_ fd))
+              ++fd;
+
+            if (fd < end)
+              used = i + 1;
+            else
+              {
+                loop_free (anfdpages [i]);
+                anfdpages [i] = 0;
+              }
+          }
+
+      array_slim (ANFD *, anfdpages, anfdpagemax, used);
+      anfd_page_max (EV_A);
+#else
+      int used = anfdmax;
+
+      while (used && anfd_unused (EV_A_ used - 1))
+        --used;
+
+      array_slim (ANFD, anfds, anfdmax, used);
+#if EV_ANFD_COLD
+      array_slim (ANFD_COLD, anfdcolds, anfdcoldmax, used);
+#endif
+#endif
+    }
+}
+
 #if EV_USE_INOTIFY
 inline_size void infy_fork (EV_P);
 #endif
@@ -2443,6 +3518,9 @@ loop_fork (EV_P)
 #if EV_USE_KQUEUE
   if (backend == EVBACKEND_KQUEUE) kqueue_fork (EV_A);
 #endif
+#if EV_USE_IOURING
+  if (backend == EVBACKEND_IOURING) iouring_fork (EV_A);
+#endif
 #if EV_USE_EPOLL
   if (backend == EVBACKEND_EPOLL ) epoll_fork  (EV_A);
 #endif
@@ -2504,7 +3582,7 @@ verify_watcher (EV_P_ W w)
   assert (("libev: watcher has invalid priority", ABSPRI (w) >= 0 && ABSPRI (w) < NUMPRI));
 
   if (w->pending)
-    assert (("libev: pending watcher not on pending queue", pendings [ABSPRI (w)][w->pending - 1].w == w));
+    assert (("libev: pending watcher not on pending queue", PENDING_ENTRY (w)->w == w));
 }
 
 static void noinline ecb_cold
@@ -2514,14 +3592,44 @@ verify_heap (EV_P_ ANHE *heap, int N)
 
   for (i = HEAP0; i < N + HEAP0; ++i)
     {
-      assert (("libev: active index mismatch in heap", ev_active (ANHE_w (heap [i])) == i));
-      assert (("libev: heap condition violated", i == HEAP0 || ANHE_at (heap [HPARENT (i)]) <= ANHE_at (heap [i])));
-      assert (("libev: heap at cache mismatch", ANHE_at (heap [i]) == ev_at (ANHE_w (heap [i]))));
+      assert (("libev: active index mismatch in heap", ev_active (HEAP_w (heap, i)) == i));
+      assert (("libev: heap condition violated", i == HEAP0 || HEAP_at (heap, HPARENT (i)) <= HEAP_at (heap, i)));
+      assert (("libev: heap at cache mismatch", HEAP_at (heap, i) == ev_at (HEAP_w (heap, i))));
 
-      verify_watcher (EV_A_ (W)ANHE_w (heap [i]));
+      verify_watcher (EV_A_ (W)HEAP_w (heap, i));
     }
 }
 
+#if EV_USE_TIMER_WHEEL
+static void noinline ecb_cold
+verify_wheel (EV_P)
+{
+  int slot, n, cnt = 0;
+
+  for (slot = 0; slot <= TW_OVERFLOW; ++slot)
+    {
+      if (slot < TW_OVERFLOW)
+        assert (("libev: timer wheel slot bit mismatch",
+                 !twslots [slot] == !(twbits [slot >> TW_BITS] & ((uint64_t)1 << (slot & TW_MASK)))));
+
+      for (n = twslots [slot]; n; n = twnodes [n].next)
+        {
+          ANTW *node = twnodes + n;
+
+          assert (("libev: timer wheel list corrupted", node->next ? twnodes [node->next].prev == n : 1));
+          assert (("libev: timer wheel slot mismatch", node->slot == slot));
+          assert (("libev: active index mismatch in timer wheel", ev_active (node->w) == -n));
+          assert (("libev: expired timer in timer wheel", tw_tick (node->w->at) > twtick));
+
+          verify_watcher (EV_A_ (W)node->w);
+          ++cnt;
+        }
+    }
+
+  assert (("libev: timer wheel count mismatch", cnt == twcnt));
+}
+#endif
+
 static void noinline ecb_cold
 array_verify (EV_P_ W *ws, int cnt)
 {
@@ -2549,31 +3657,43 @@ ev_verify (EV_P)
 
   assert (anfdmax >= 0);
   for (i = 0; i < anfdmax; ++i)
-    for (w = anfds [i].head; w; w = w->next)
+    if (expect_false (!ANFD_PRESENT (i)))
+      i |= ANFD_PAGE_MASK;
+    else
+    for (w = ANFD_AT (i)->head; w; w = w->next)
       {
         verify_watcher (EV_A_ (W)w);
         assert (("libev: inactive fd watcher on anfd list", ev_active (w) == 1));
         assert (("libev: fd mismatch between watcher and anfd", ((ev_io *)w)->fd == i));
       }
 
-  assert (timermax >= timercnt);
+  assert (timermax >= ANHE_NEED (timercnt));
   verify_heap (EV_A_ timers, timercnt);
+#if EV_USE_TIMER_WHEEL
+  assert (twnodemax > twnodecnt || !twnodecnt);
+  verify_wheel (EV_A);
+#endif
 
 #if EV_PERIODIC_ENABLE
-  assert (periodicmax >= periodiccnt);
+  assert (periodicmax >= ANHE_NEED (periodiccnt));
   verify_heap (EV_A_ periodics, periodiccnt);
 #endif
 
   for (i = NUMPRI; i--; )
     {
       assert (pendingmax [i] >= pendingcnt [i]);
+      assert (pendingcnt [i] >= pendinghead [i]);
+      assert (("libev: pending priority missing from bitmap", !pendingcnt [i] || PRIBIT_TST (pendingbits, i)));
 #if EV_IDLE_ENABLE
       assert (idleall >= 0);
       assert (idlemax [i] >= idlecnt [i]);
+      assert (("libev: idle priority bitmap inconsistent", !idlecnt [i] == !PRIBIT_TST (idlebits, i)));
       array_verify (EV_A_ (W *)idles [i], idlecnt [i]);
 #endif
     }
 
+  assert (deferredmax >= deferredcnt);
+
 #if EV_FORK_ENABLE
   assert (forkmax >= forkcnt);
   array_verify (EV_A_ (W *)forks, forkcnt);
@@ -2656,32 +3776,204 @@ ev_invoke (EV_P_ void *w, int revents)
   EV_CB_INVOKE ((W)w, revents);
 }
 
-unsigned int
-ev_pending_count (EV_P)
+unsigned int
+ev_pending_count (EV_P)
+{
+  int i;
+  unsigned int count = 0;
+
+  for (i = PRIWORDS; i--; )
+    {
+      uint32_t bits = pendingbits [i];
+
+      while (bits)
+        {
+          int pri = (i << 5) + ecb_ctz32 (bits);
+
+          count += pendingcnt [pri] - pendinghead [pri];
+          bits &= bits - 1;
+        }
+    }
+
+  /* deferred watchers don't count, as only ev_run makes them pending */
+  /* again, so callers looping until this is zero would never finish */
+  return count;
+}
+
+#if EV_FEATURE_API
+/* the callback class of a watcher, which we can only guess from its revents */
+inline_speed int
+stats_cb_class (int revents)
+{
+  unsigned int type = (revents >> 8) & 0xfff; /* EV_TIMER .. EV_ASYNC */
+
+  return type                             ? EV_CLASS_TIMER + ecb_ctz32 (type)
+       : revents & (EV_READ | EV_WRITE)   ? EV_CLASS_IO
+       :                                    EV_CLASS_OTHER;
+}
+
+/* invoke a callback and account the time it took */
+static void noinline
+invoke_timed (EV_P_ W w, int revents)
+{
+  int cls = stats_cb_class (revents);
+  ev_time_t start = get_clock ();
+  ev_tstamp elapsed;
+
+  w->pending = 0;
+  EV_CB_INVOKE (w, revents);
+
+  elapsed = EV_TIME_TO_TS (get_clock () - start);
+
+  ++loop_stats.cb_count [cls];
+  loop_stats.cb_time [cls] += elapsed;
+  if (loop_stats.cb_max [cls] < elapsed)
+    loop_stats.cb_max [cls] = elapsed;
+  ++loop_stats.cb_hist [cls][stats_time_bucket (elapsed)];
+
+  /* w might be gone by now, so the hook only gets to see its address */
+  if (expect_false (slow_cb && elapsed >= slow_threshold))
+    slow_cb (EV_A_ (void *)w, revents, elapsed);
+}
+#endif
+
+inline_size void
+pending_defer_one (EV_P_ ANPENDING *p)
+{
+  if (p->w == (W)&pending_w) /* cleared */
+    return;
+
+  array_needsize (ANPENDING, deferreds, deferredmax, deferredcnt + 1, EMPTY2);
+  deferreds [deferredcnt] = *p;
+  p->w->pending = -++deferredcnt;
+#if EV_FEATURE_API
+  ++loop_stats.deferred;
+#endif
+}
+
+inline_speed void
+invoke_one (EV_P_ int pri, ANPENDING *p)
+{
+#if EV_FEATURE_API
+  ++loop_stats.invoked [pri];
+
+  if (expect_false (cb_timing))
+    /* the callback might resize pendings, so pass what we need */
+    invoke_timed (EV_A_ p->w, p->events);
+  else
+#endif
+    {
+      p->w->pending = 0;
+      EV_CB_INVOKE (p->w, p->events);
+    }
+
+  EV_FREQUENT_CHECK;
+}
+
+/* the invoke budget is used up, so move all remaining pending watchers */
+/* to deferreds, from where ev_run feeds them again in its next iteration */
+static void noinline
+pending_defer (EV_P)
+{
+  int pri;
+
+#if EV_FEATURE_API
+  ++loop_stats.budget_hits;
+#endif
+
+  for (pri = pri_highest (pendingbits); pri >= 0; pri = pri_below (pendingbits, pri))
+    {
+      int i;
+
+      /* keep array order, so feeding them again reproduces the invoke order */
+      for (i = pendinghead [pri]; i < pendingcnt [pri]; ++i)
+        pending_defer_one (EV_A_ pendings [pri] + i);
+
+      pendingcnt [pri] = pendinghead [pri] = 0;
+      PRIBIT_CLR (pendingbits, pri);
+    }
+}
+
+/* whether ev_invoke_pending has used up its budget, in callbacks or in time */
+inline_speed int
+invoke_exhausted (EV_P_ unsigned int *left, unsigned int budget, ev_time_t deadline)
 {
-  int pri;
-  unsigned int count = 0;
+  if (expect_false (!(*left)--))
+    return 1;
 
-  for (pri = NUMPRI; pri--; )
-    count += pendingcnt [pri];
+  /* the time is not checked before the first callback, so every call */
+  /* makes progress even when the interval is shorter than a clock query */
+  if (expect_false (deadline) && *left + 1 != budget && get_clock () >= deadline)
+    {
+#if EV_FEATURE_API
+      ++loop_stats.time_budget_hits;
+#endif
+      return 1;
+    }
 
-  return count;
+  return 0;
 }
 
 void noinline
 ev_invoke_pending (EV_P)
 {
   int pri;
+  unsigned int budget = invoke_budget ? invoke_budget : -1U;
+  unsigned int left = budget;
+  ev_time_t deadline = invoke_time_budget ? get_clock () + invoke_time_budget : 0;
+
+  /* a single pass from the highest priority down, the bitmap only skips */
+  /* empty levels. watchers that callbacks feed at a higher priority than */
+  /* the current one are invoked by the next call, as they always were */
+  for (pri = pri_highest (pendingbits); pri >= 0; pri = pri_below (pendingbits, pri))
+    {
+      /* in fifo order, invoked watchers stay in the array until all are done */
+      if (expect_false (pending_fifo))
+        while (pendinghead [pri] < pendingcnt [pri])
+          {
+            if (invoke_exhausted (EV_A_ &left, budget, deadline))
+              {
+                pending_defer (EV_A);
+                return;
+              }
 
-  for (pri = NUMPRI; pri--; )
-    while (pendingcnt [pri])
-      {
-        ANPENDING *p = pendings [pri] + --pendingcnt [pri];
+            invoke_one (EV_A_ pri, pendings [pri] + pendinghead [pri]++);
+          }
+      else
+        while (pendingcnt [pri])
+          {
+            if (invoke_exhausted (EV_A_ &left, budget, deadline))
+              {
+                pending_defer (EV_A);
+                return;
+              }
 
-        p->w->pending = 0;
-        EV_CB_INVOKE (p->w, p->events);
-        EV_FREQUENT_CHECK;
-      }
+            invoke_one (EV_A_ pri, pendings [pri] + --pendingcnt [pri]);
+          }
+
+      pendingcnt [pri] = pendinghead [pri] = 0;
+      PRIBIT_CLR (pendingbits, pri);
+    }
+}
+
+/* feed deferred watchers again, in their original order */
+static void noinline
+pending_undefer (EV_P)
+{
+  int i, cnt = deferredcnt;
+
+  deferredcnt = 0;
+
+  for (i = 0; i < cnt; ++i)
+    {
+      W w = deferreds [i].w;
+
+      if (w != (W)&pending_w) /* skip cleared ones */
+        {
+          w->pending = 0;
+          ev_feed_event (EV_A_ w, deferreds [i].events);
+        }
+    }
 }
 
 #if EV_IDLE_ENABLE
@@ -2692,22 +3984,46 @@ idle_reify (EV_P)
 {
   if (expect_false (idleall))
     {
-      int pri;
+      int pri = pri_highest (idlebits);
+
+      if (pri > pri_highest (pendingbits))
+        queue_events (EV_A_ (W *)idles [pri], idlecnt [pri], EV_IDLE);
+    }
+}
+#endif
+
+/*
+ * a timer that has just been scheduled to expire in timeout seconds
+ * may expire up to its slack later. we move its expiry time up to the
+ * next multiple of the largest power of two within the slack, so timers
+ * that expire at about the same time share the same wakeup.
+ */
+inline_speed void
+timer_coalesce (EV_P_ ev_timer *w, ev_tstamp timeout)
+{
+  if (expect_false (timer_slack_max > 0.))
+    {
+      ev_tstamp slack = timeout * timer_slack;
+
+      if (slack > timer_slack_max)
+        slack = timer_slack_max;
 
-      for (pri = NUMPRI; pri--; )
+      if (slack >= 1e-6)
         {
-          if (pendingcnt [pri])
-            break;
+#if EV_USE_NSEC
+          /* the grid is a power of two microseconds */
+          ev_time_t grid = ((ev_time_t)1 << ecb_ld32 ((uint32_t)(slack * 1e6))) * 1000;
 
-          if (idlecnt [pri])
-            {
-              queue_events (EV_A_ (W *)idles [pri], idlecnt [pri], EV_IDLE);
-              break;
-            }
+          ev_at (w) = (ev_at (w) + grid - 1) / grid * grid;
+#else
+          /* the grid is a power of two seconds, which keeps the division exact */
+          ev_tstamp grid = (ev_tstamp)((uint32_t)1 << ecb_ld32 ((uint32_t)(slack * 1048576.))) * (1. / 1048576.);
+
+          ev_at (w) = -ev_floor (-ev_at (w) / grid) * grid;
+#endif
         }
     }
 }
-#endif
 
 /* make timers pending */
 inline_size void
@@ -2715,25 +4031,35 @@ timers_reify (EV_P)
 {
   EV_FREQUENT_CHECK;
 
-  if (timercnt && ANHE_at (timers [HEAP0]) < mn_now)
+#if EV_USE_TIMER_WHEEL
+  tw_advance (EV_A);
+#endif
+
+  if (timercnt && HEAP_at (timers, HEAP0) < mn_now)
     {
       do
         {
-          ev_timer *w = (ev_timer *)ANHE_w (timers [HEAP0]);
+          ev_timer *w = (ev_timer *)HEAP_w (timers, HEAP0);
 
           /*assert (("libev: inactive timer on timer heap detected", ev_is_active (w)));*/
 
           /* first reschedule or stop timer */
           if (w->repeat)
             {
-              ev_at (w) += w->repeat;
+              ev_at (w) += EV_TIME_FROM_TS (w->repeat);
               if (ev_at (w) < mn_now)
                 ev_at (w) = mn_now;
 
+              timer_coalesce (EV_A_ w, w->repeat);
+
               assert (("libev: negative ev_timer repeat value found while processing timers", w->repeat > 0.));
 
-              ANHE_at_cache (timers [HEAP0]);
+#if EV_USE_TIMER_WHEEL
+              timer_move (EV_A_ w);
+#else
+              HEAP_at_cache (timers, HEAP0);
               downheap (timers, timercnt, HEAP0);
+#endif
             }
           else
             ev_timer_stop (EV_A_ w); /* nonrepeating: stop timer */
@@ -2741,8 +4067,11 @@ timers_reify (EV_P)
           EV_FREQUENT_CHECK;
           feed_reverse (EV_A_ (W)w);
         }
-      while (timercnt && ANHE_at (timers [HEAP0]) < mn_now);
+      while (timercnt && HEAP_at (timers, HEAP0) < mn_now);
 
+#if EV_FEATURE_API
+      loop_stats.timers_fired += rfeedcnt;
+#endif
       feed_reverse_done (EV_A_ EV_TIMER);
     }
 }
@@ -2770,39 +4099,41 @@ periodic_recalc (EV_P_ ev_periodic *w)
       at = nat;
     }
 
-  ev_at (w) = at;
+  ev_at (w) = EV_TIME_FROM_TS (at);
 }
 
 /* make periodics pending */
 inline_size void
 periodics_reify (EV_P)
 {
+  ev_time_t rt_now = EV_TIME_FROM_TS (ev_rt_now);
+
   EV_FREQUENT_CHECK;
 
-  while (periodiccnt && ANHE_at (periodics [HEAP0]) < ev_rt_now)
+  while (periodiccnt && HEAP_at (periodics, HEAP0) < rt_now)
     {
       int feed_count = 0;
 
       do
         {
-          ev_periodic *w = (ev_periodic *)ANHE_w (periodics [HEAP0]);
+          ev_periodic *w = (ev_periodic *)HEAP_w (periodics, HEAP0);
 
           /*assert (("libev: inactive timer on periodic heap detected", ev_is_active (w)));*/
 
           /* first reschedule or stop timer */
           if (w->reschedule_cb)
             {
-              ev_at (w) = w->reschedule_cb (w, ev_rt_now);
+              ev_at (w) = EV_TIME_FROM_TS (w->reschedule_cb (w, ev_rt_now));
 
-              assert (("libev: ev_periodic reschedule callback returned time in the past", ev_at (w) >= ev_rt_now));
+              assert (("libev: ev_periodic reschedule callback returned time in the past", ev_at (w) >= rt_now));
 
-              ANHE_at_cache (periodics [HEAP0]);
+              HEAP_at_cache (periodics, HEAP0);
               downheap (periodics, periodiccnt, HEAP0);
             }
           else if (w->interval)
             {
               periodic_recalc (EV_A_ w);
-              ANHE_at_cache (periodics [HEAP0]);
+              HEAP_at_cache (periodics, HEAP0);
               downheap (periodics, periodiccnt, HEAP0);
             }
           else
@@ -2811,8 +4142,11 @@ periodics_reify (EV_P)
           EV_FREQUENT_CHECK;
           feed_reverse (EV_A_ (W)w);
         }
-      while (periodiccnt && ANHE_at (periodics [HEAP0]) < ev_rt_now);
+      while (periodiccnt && HEAP_at (periodics, HEAP0) < rt_now);
 
+#if EV_FEATURE_API
+      loop_stats.periodics_fired += rfeedcnt;
+#endif
       feed_reverse_done (EV_A_ EV_PERIODIC);
     }
 }
@@ -2827,14 +4161,14 @@ periodics_reschedule (EV_P)
   /* adjust periodics after time jump */
   for (i = HEAP0; i < periodiccnt + HEAP0; ++i)
     {
-      ev_periodic *w = (ev_periodic *)ANHE_w (periodics [i]);
+      ev_periodic *w = (ev_periodic *)HEAP_w (periodics, i);
 
       if (w->reschedule_cb)
-        ev_at (w) = w->reschedule_cb (w, ev_rt_now);
+        ev_at (w) = EV_TIME_FROM_TS (w->reschedule_cb (w, ev_rt_now));
       else if (w->interval)
         periodic_recalc (EV_A_ w);
 
-      ANHE_at_cache (periodics [i]);
+      HEAP_at_cache (periodics, i);
     }
 
   reheap (periodics, periodiccnt);
@@ -2843,16 +4177,19 @@ periodics_reschedule (EV_P)
 
 /* adjust all timers by a given offset */
 static void noinline ecb_cold
-timers_reschedule (EV_P_ ev_tstamp adjust)
+timers_reschedule (EV_P_ ev_time_t adjust)
 {
   int i;
 
   for (i = 0; i < timercnt; ++i)
     {
-      ANHE *he = timers + i + HEAP0;
-      ANHE_w (*he)->at += adjust;
-      ANHE_at_cache (*he);
+      HEAP_w (timers, i + HEAP0)->at += adjust;
+      HEAP_at_cache (timers, i + HEAP0);
     }
+
+#if EV_USE_TIMER_WHEEL
+  tw_reschedule (EV_A_ adjust);
+#endif
 }
 
 /* fetch new monotonic and realtime times from the kernel */
@@ -2864,15 +4201,15 @@ time_update (EV_P_ ev_tstamp max_block)
   if (expect_true (have_monotonic))
     {
       int i;
-      ev_tstamp odiff = rtmn_diff;
+      ev_time_t odiff = rtmn_diff;
 
       mn_now = get_clock ();
 
       /* only fetch the realtime clock every 0.5*MIN_TIMEJUMP seconds */
       /* interpolate in the meantime */
-      if (expect_true (mn_now - now_floor < MIN_TIMEJUMP * .5))
+      if (expect_true (mn_now - now_floor < EV_TIME_FROM_TS (MIN_TIMEJUMP * .5)))
         {
-          ev_rt_now = rtmn_diff + mn_now;
+          ev_rt_now = EV_TIME_TO_TS (rtmn_diff + mn_now);
           return;
         }
 
@@ -2889,12 +4226,12 @@ time_update (EV_P_ ev_tstamp max_block)
        */
       for (i = 4; --i; )
         {
-          ev_tstamp diff;
-          rtmn_diff = ev_rt_now - mn_now;
+          ev_time_t diff;
+          rtmn_diff = EV_TIME_FROM_TS (ev_rt_now) - mn_now;
 
           diff = odiff - rtmn_diff;
 
-          if (expect_true ((diff < 0. ? -diff : diff) < MIN_TIMEJUMP))
+          if (expect_true ((diff < 0 ? -diff : diff) < EV_TIME_FROM_TS (MIN_TIMEJUMP)))
             return; /* all is well */
 
           ev_rt_now = ev_time ();
@@ -2911,20 +4248,49 @@ time_update (EV_P_ ev_tstamp max_block)
   else
 #endif
     {
+      ev_time_t rt_now;
+
       ev_rt_now = ev_time ();
+      rt_now = EV_TIME_FROM_TS (ev_rt_now);
 
-      if (expect_false (mn_now > ev_rt_now || ev_rt_now > mn_now + max_block + MIN_TIMEJUMP))
+      if (expect_false (mn_now > rt_now || ev_rt_now > EV_TIME_TO_TS (mn_now) + max_block + MIN_TIMEJUMP))
         {
           /* adjust timers. this is easy, as the offset is the same for all of them */
-          timers_reschedule (EV_A_ ev_rt_now - mn_now);
+          timers_reschedule (EV_A_ rt_now - mn_now);
 #if EV_PERIODIC_ENABLE
           periodics_reschedule (EV_A);
 #endif
         }
 
-      mn_now = ev_rt_now;
+      mn_now = rt_now;
+    }
+}
+
+#if EV_FEATURE_API
+/* poll without blocking for up to busy_poll seconds, but at most */
+/* waittime. returns the time spent, or a negative value if events arrived */
+static ev_tstamp noinline
+busy_spin (EV_P_ ev_tstamp waittime)
+{
+  unsigned long poll_events = loop_stats.poll_events;
+  ev_time_t start = get_clock ();
+  ev_time_t end = start + EV_TIME_FROM_TS (busy_poll < waittime ? busy_poll : waittime);
+  ev_time_t now;
+
+  busy_spinning = 1;
+
+  do
+    {
+      backend_poll (EV_A_ 0.);
+      now = get_clock ();
     }
+  while (loop_stats.poll_events == poll_events && now < end);
+
+  busy_spinning = 0;
+
+  return loop_stats.poll_events == poll_events ? EV_TIME_TO_TS (now - start) : -1.;
 }
+#endif
 
 void
 ev_run (EV_P_ int flags)
@@ -2980,6 +4346,11 @@ ev_run (EV_P_ int flags)
       if (expect_false (postfork))
         loop_fork (EV_A);
 
+      /* before fd_reify, so all fds without watchers have been removed from */
+      /* the kernel, and backends cannot report errors for them anymore */
+      if (expect_false (shrink_interval && !--shrink_countdown))
+        loop_shrink (EV_A);
+
       /* update fd-related kernel structures */
       fd_reify (EV_A);
 
@@ -2989,30 +4360,47 @@ ev_run (EV_P_ int flags)
         ev_tstamp sleeptime = 0.;
 
         /* remember old timestamp for io_blocktime calculation */
-        ev_tstamp prev_mn_now = mn_now;
+        ev_time_t prev_mn_now = mn_now;
+
+#if EV_FEATURE_API
+        ev_time_t poll_start;
+        unsigned long poll_events;
+#endif
 
         /* update time to cancel out callback processing overhead */
         time_update (EV_A_ 1e100);
 
+#if EV_FEATURE_API
+        poll_start = mn_now;
+#endif
+
         /* from now on, we want a pipe-wake-up */
         pipe_write_wanted = 1;
 
         ECB_MEMORY_FENCE; /* make sure pipe_write_wanted is visible before we check for potential skips */
 
-        if (expect_true (!(flags & EVRUN_NOWAIT || idleall || !activecnt || pipe_write_skipped)))
+        if (expect_true (!(flags & EVRUN_NOWAIT || idleall || !activecnt || pipe_write_skipped || deferredcnt)))
           {
             waittime = MAX_BLOCKTIME;
 
             if (timercnt)
               {
-                ev_tstamp to = ANHE_at (timers [HEAP0]) - mn_now;
+                ev_tstamp to = EV_TIME_TO_TS (HEAP_at (timers, HEAP0) - mn_now);
+                if (waittime > to) waittime = to;
+              }
+
+#if EV_USE_TIMER_WHEEL
+            if (twcnt)
+              {
+                ev_tstamp to = tw_next (EV_A) * (1. / TW_HZ) - EV_TIME_TO_TS (mn_now);
                 if (waittime > to) waittime = to;
               }
+#endif
 
 #if EV_PERIODIC_ENABLE
             if (periodiccnt)
               {
-                ev_tstamp to = ANHE_at (periodics [HEAP0]) - ev_rt_now;
+                ev_tstamp to = EV_TIME_TO_TS (HEAP_at (periodics, HEAP0)) - ev_rt_now;
                 if (waittime > to) waittime = to;
               }
 #endif
@@ -3029,7 +4417,7 @@ ev_run (EV_P_ int flags)
             /* extra check because io_blocktime is commonly 0 */
             if (expect_false (io_blocktime))
               {
-                sleeptime = io_blocktime - (mn_now - prev_mn_now);
+                sleeptime = io_blocktime - EV_TIME_TO_TS (mn_now - prev_mn_now);
 
                 if (sleeptime > waittime - backend_mintime)
                   sleeptime = waittime - backend_mintime;
@@ -3044,8 +4432,30 @@ ev_run (EV_P_ int flags)
 
 #if EV_FEATURE_API
         ++loop_count;
+        ++loop_stats.poll_count;
+        poll_events = loop_stats.poll_events;
 #endif
+        /* watchers left over by the invoke budget go first */
+        if (expect_false (deferredcnt))
+          pending_undefer (EV_A);
+
         assert ((loop_done = EVBREAK_RECURSE, 1)); /* assert for side effect */
+#if EV_FEATURE_API
+        /* busy polling only makes sense if we would block otherwise */
+        if (expect_false (busy_poll > 0.) && waittime > 0.)
+          {
+            ev_tstamp spun = busy_spin (EV_A_ waittime);
+
+            if (spun < 0.)
+              ++loop_stats.spin_hits;
+            else if (spun < waittime)
+              {
+                ++loop_stats.spin_blocks;
+                backend_poll (EV_A_ waittime - spun);
+              }
+          }
+        else
+#endif
         backend_poll (EV_A_ waittime);
         assert ((loop_done = EVBREAK_CANCEL, 1)); /* assert for side effect */
 
@@ -3060,6 +4470,26 @@ ev_run (EV_P_ int flags)
 
         /* update ev_rt_now, do magic */
         time_update (EV_A_ waittime + sleeptime);
+
+#if EV_FEATURE_API
+        ++loop_stats.poll_events_hist [stats_bucket (loop_stats.poll_events - poll_events)];
+
+        if (expect_false (io_collect_max > 0.))
+          io_collect_adapt (
+            EV_A_
+            EV_TIME_TO_TS (poll_start - prev_mn_now), /* time since the previous poll */
+            EV_TIME_TO_TS (mn_now - poll_start),      /* time spent sleeping and polling */
+            loop_stats.poll_events - poll_events
+          );
+
+        if (expect_false (loop_stats_timing))
+          {
+            ev_tstamp blocked = EV_TIME_TO_TS (mn_now - poll_start);
+
+            loop_stats.blocked += blocked;
+            ++loop_stats.blocked_hist [stats_time_bucket (blocked)];
+          }
+#endif
       }
 
       /* queue pending timers and reschedule them */
@@ -3079,6 +4509,20 @@ ev_run (EV_P_ int flags)
         queue_events (EV_A_ (W *)checks, checkcnt, EV_CHECK);
 #endif
 
+#if EV_FEATURE_API
+      if (expect_false (loop_stats_timing))
+        {
+          ev_time_t start = get_clock ();
+          ev_tstamp invoking;
+
+          EV_INVOKE_PENDING;
+
+          invoking = EV_TIME_TO_TS (get_clock () - start);
+          loop_stats.invoking += invoking;
+          ++loop_stats.invoking_hist [stats_time_bucket (invoking)];
+        }
+      else
+#endif
       EV_INVOKE_PENDING;
     }
   while (expect_true (
@@ -3128,7 +4572,7 @@ ev_suspend (EV_P)
 void
 ev_resume (EV_P)
 {
-  ev_tstamp mn_prev = mn_now;
+  ev_time_t mn_prev = mn_now;
 
   ev_now_update (EV_A);
   timers_reschedule (EV_A_ mn_now - mn_prev);
@@ -3169,7 +4613,7 @@ clear_pending (EV_P_ W w)
 {
   if (w->pending)
     {
-      pendings [ABSPRI (w)][w->pending - 1].w = (W)&pending_w;
+      PENDING_ENTRY (w)->w = (W)&pending_w;
       w->pending = 0;
     }
 }
@@ -3182,7 +4626,7 @@ ev_clear_pending (EV_P_ void *w)
 
   if (expect_true (pending))
     {
-      ANPENDING *p = pendings [ABSPRI (w_)] + pending - 1;
+      ANPENDING *p = PENDING_ENTRY (w_);
       p->w = (W)&pending_w;
       w_->pending = 0;
       return p->events;
@@ -3226,13 +4670,20 @@ ev_io_start (EV_P_ ev_io *w)
     return;
 
   assert (("libev: ev_io_start called with negative fd", fd >= 0));
-  assert (("libev: ev_io_start called with illegal event mask", !(w->events & ~(EV__IOFDSET | EV_READ | EV_WRITE))));
+  assert (("libev: ev_io_start called with illegal event mask", !(w->events & ~(EV__IOFDSET | EV_READ | EV_WRITE | EV_ET | EV_EXCLUSIVE))));
 
   EV_FREQUENT_CHECK;
 
   ev_start (EV_A_ (W)w, 1);
+#if EV_USE_ANFD_PAGES
+  anfd_page_need (EV_A_ fd);
+#else
   array_needsize (ANFD, anfds, anfdmax, fd + 1, array_init_zero);
-  wlist_add (&anfds[fd].head, (WL)w);
+#if EV_ANFD_COLD
+  array_needsize (ANFD_COLD, anfdcolds, anfdcoldmax, fd + 1, array_init_zero);
+#endif
+#endif
+  wlist_add (&ANFD_AT (fd)->head, (WL)w);
 
   fd_change (EV_A_ fd, w->events & EV__IOFDSET | EV_ANFD_REIFY);
   w->events &= ~EV__IOFDSET;
@@ -3251,7 +4702,7 @@ ev_io_stop (EV_P_ ev_io *w)
 
   EV_FREQUENT_CHECK;
 
-  wlist_del (&anfds[w->fd].head, (WL)w);
+  wlist_del (&ANFD_AT (w->fd)->head, (WL)w);
   ev_stop (EV_A_ (W)w);
 
   fd_change (EV_A_ w->fd, EV_ANFD_REIFY);
@@ -3266,16 +4717,27 @@ ev_timer_start (EV_P_ ev_timer *w)
     return;
 
   ev_at (w) += mn_now;
+  timer_coalesce (EV_A_ w, EV_TIME_TO_TS (ev_at (w) - mn_now));
 
   assert (("libev: ev_timer_start called with negative timer repeat value", w->repeat >= 0.));
 
   EV_FREQUENT_CHECK;
 
+#if EV_USE_TIMER_WHEEL
+  if (tw_tick (ev_at (w)) > twtick)
+    {
+      ev_start (EV_A_ (W)w, 0);
+      tw_insert (EV_A_ w);
+      EV_FREQUENT_CHECK;
+      return;
+    }
+#endif
+
   ++timercnt;
   ev_start (EV_A_ (W)w, timercnt + HEAP0 - 1);
-  array_needsize (ANHE, timers, timermax, ev_active (w) + 1, EMPTY2);
-  ANHE_w (timers [ev_active (w)]) = (WT)w;
-  ANHE_at_cache (timers [ev_active (w)]);
+  array_needsize (ANHE, timers, timermax, ANHE_NEED (ev_active (w) + 1), EMPTY2);
+  HEAP_w (timers, ev_active (w)) = (WT)w;
+  HEAP_at_cache (timers, ev_active (w));
   upheap (timers, ev_active (w));
 
   EV_FREQUENT_CHECK;
@@ -3295,14 +4757,26 @@ ev_timer_stop (EV_P_ ev_timer *w)
   {
     int active = ev_active (w);
 
-    assert (("libev: internal timer heap corruption", ANHE_w (timers [active]) == (WT)w));
-
-    --timercnt;
+#if EV_USE_TIMER_WHEEL
+    if (active < 0)
+      {
+        assert (("libev: internal timer wheel corruption", twnodes [-active].w == (WT)w));
 
-    if (expect_true (active < timercnt + HEAP0))
+        tw_unlink (EV_A_ -active);
+        tw_free (EV_A_ -active);
+      }
+    else
+#endif
       {
-        timers [active] = timers [timercnt + HEAP0];
-        adjustheap (timers, timercnt, active);
+        assert (("libev: internal timer heap corruption", HEAP_w (timers, active) == (WT)w));
+
+        --timercnt;
+
+        if (expect_true (active < timercnt + HEAP0))
+          {
+            HEAP_move (timers, active, timercnt + HEAP0);
+            adjustheap (timers, timercnt, active);
+          }
       }
   }
 
@@ -3324,16 +4798,21 @@ ev_timer_again (EV_P_ ev_timer *w)
     {
       if (w->repeat)
         {
-          ev_at (w) = mn_now + w->repeat;
-          ANHE_at_cache (timers [ev_active (w)]);
+          ev_at (w) = mn_now + EV_TIME_FROM_TS (w->repeat);
+          timer_coalesce (EV_A_ w, w->repeat);
+#if EV_USE_TIMER_WHEEL
+          timer_move (EV_A_ w);
+#else
+          HEAP_at_cache (timers, ev_active (w));
           adjustheap (timers, timercnt, ev_active (w));
+#endif
         }
       else
         ev_timer_stop (EV_A_ w);
     }
   else if (w->repeat)
     {
-      ev_at (w) = w->repeat;
+      ev_at (w) = EV_TIME_FROM_TS (w->repeat);
       ev_timer_start (EV_A_ w);
     }
 
@@ -3343,7 +4822,7 @@ ev_timer_again (EV_P_ ev_timer *w)
 ev_tstamp
 ev_timer_remaining (EV_P_ ev_timer *w)
 {
-  return ev_at (w) - (ev_is_active (w) ? mn_now : 0.);
+  return EV_TIME_TO_TS (ev_at (w) - (ev_is_active (w) ? mn_now : 0));
 }
 
 #if EV_PERIODIC_ENABLE
@@ -3354,27 +4833,27 @@ ev_periodic_start (EV_P_ ev_periodic *w)
     return;
 
   if (w->reschedule_cb)
-    ev_at (w) = w->reschedule_cb (w, ev_rt_now);
+    ev_at (w) = EV_TIME_FROM_TS (w->reschedule_cb (w, ev_rt_now));
   else if (w->interval)
     {
       assert (("libev: ev_periodic_start called with negative interval value", w->interval >= 0.));
       periodic_recalc (EV_A_ w);
     }
   else
-    ev_at (w) = w->offset;
+    ev_at (w) = EV_TIME_FROM_TS (w->offset);
 
   EV_FREQUENT_CHECK;
 
   ++periodiccnt;
   ev_start (EV_A_ (W)w, periodiccnt + HEAP0 - 1);
-  array_needsize (ANHE, periodics, periodicmax, ev_active (w) + 1, EMPTY2);
-  ANHE_w (periodics [ev_active (w)]) = (WT)w;
-  ANHE_at_cache (periodics [ev_active (w)]);
+  array_needsize (ANHE, periodics, periodicmax, ANHE_NEED (ev_active (w) + 1), EMPTY2);
+  HEAP_w (periodics, ev_active (w)) = (WT)w;
+  HEAP_at_cache (periodics, ev_active (w));
   upheap (periodics, ev_active (w));
 
   EV_FREQUENT_CHECK;
 
-  /*assert (("libev: internal periodic heap corruption", ANHE_w (periodics [ev_active (w)]) == (WT)w));*/
+  /*assert (("libev: internal periodic heap corruption", HEAP_w (periodics, ev_active (w)) == (WT)w));*/
 }
 
 void noinline
@@ -3389,13 +4868,13 @@ ev_periodic_stop (EV_P_ ev_periodic *w)
   {
     int active = ev_active (w);
 
-    assert (("libev: internal periodic heap corruption", ANHE_w (periodics [active]) == (WT)w));
+    assert (("libev: internal periodic heap corruption", HEAP_w (periodics, active) == (WT)w));
 
     --periodiccnt;
 
     if (expect_true (active < periodiccnt + HEAP0))
       {
-        periodics [active] = periodics [periodiccnt + HEAP0];
+        HEAP_move (periodics, active, periodiccnt + HEAP0);
         adjustheap (periodics, periodiccnt, active);
       }
   }
@@ -3941,6 +5420,7 @@ ev_idle_start (EV_P_ ev_idle *w)
     int active = ++idlecnt [ABSPRI (w)];
 
     ++idleall;
+    PRIBIT_SET (idlebits, ABSPRI (w));
     ev_start (EV_A_ (W)w, active);
 
     array_needsize (ev_idle *, idles [ABSPRI (w)], idlemax [ABSPRI (w)], active, EMPTY2);
@@ -3965,6 +5445,9 @@ ev_idle_stop (EV_P_ ev_idle *w)
     idles [ABSPRI (w)][active - 1] = idles [ABSPRI (w)][--idlecnt [ABSPRI (w)]];
     ev_active (idles [ABSPRI (w)][active - 1]) = active;
 
+    if (!idlecnt [ABSPRI (w)])
+      PRIBIT_CLR (idlebits, ABSPRI (w));
+
     ev_stop (EV_A_ (W)w);
     --idleall;
   }
@@ -4238,6 +5721,24 @@ ev_cleanup_stop (EV_P_ ev_cleanup *w)
 #endif
 
 #if EV_ASYNC_ENABLE
+/* mark the async watcher at index i as sent, can be called from any thread */
+inline_speed void
+async_mark (EV_P_ int i)
+{
+#if EV_HAVE_ATOMICS
+  if (expect_true (i < ASYNC_MAX))
+    {
+      int chunk = i >> ASYNC_CHUNK_BITS;
+      int word  = (i >> 5) & 31;
+
+      EV_ATOMIC_OR (&asyncbits [chunk][word], 1U << (i & 31));
+      EV_ATOMIC_OR (&asyncsum [chunk], 1U << word);
+    }
+  else
+#endif
+    async_overflow = 1;
+}
+
 void
 ev_async_start (EV_P_ ev_async *w)
 {
@@ -4250,6 +5751,14 @@ ev_async_start (EV_P_ ev_async *w)
 
   EV_FREQUENT_CHECK;
 
+  /* the bitmap chunk must exist before anybody can send to the watcher */
+  if (expect_false (asynccnt < ASYNC_MAX && asynccnt >> ASYNC_CHUNK_BITS == asyncchunks))
+    {
+      asyncbits [asyncchunks] = (unsigned int volatile *)loop_malloc (sizeof (unsigned int) * 32);
+      memset ((void *)asyncbits [asyncchunks], 0, sizeof (unsigned int) * 32);
+      ++asyncchunks;
+    }
+
   ev_start (EV_A_ (W)w, ++asynccnt);
   array_needsize (ev_async *, asyncs, asyncmax, asynccnt, EMPTY2);
   asyncs [asynccnt - 1] = w;
@@ -4271,6 +5780,20 @@ ev_async_stop (EV_P_ ev_async *w)
 
     asyncs [active - 1] = asyncs [--asynccnt];
     ev_active (asyncs [active - 1]) = active;
+
+    if (active - 1 < asynccnt)
+      {
+        /* a concurrent ev_async_send might have used the old index of the */
+        /* moved watcher, so we check it ourselves - this pairs with the */
+        /* fence in ev_async_send */
+        ECB_MEMORY_FENCE;
+
+        if (asyncs [active - 1]->sent)
+          {
+            async_mark (EV_A_ active - 1);
+            evpipe_write (EV_A_ &async_pending);
+          }
+      }
   }
 
   ev_stop (EV_A_ (W)w);
@@ -4282,8 +5805,138 @@ void
 ev_async_send (EV_P_ ev_async *w)
 {
   w->sent = 1;
+
+  ECB_MEMORY_FENCE; /* make sure sent is visible before we read the index */
+
+  if (expect_true (ev_active (w)))
+    async_mark (EV_A_ ev_active (w) - 1);
+
   evpipe_write (EV_A_ &async_pending);
 }
+
+#if EV_HAVE_ATOMICS
+/*
+ * ev_async_queue is a bounded queue as described by dmitry vyukov: every
+ * cell has a sequence number that tells producers and the consumer whether
+ * the cell is free for position seq or filled for position seq - 1.
+ * producers claim positions with a cas on tail, the single consumer
+ * owns head. count is the number of claimed positions not yet consumed,
+ * and only the producer that makes it non-zero needs to signal the watcher.
+ */
+struct ev_async_cell
+{
+  unsigned int volatile seq;
+  void *msg;
+};
+
+void
+ev_async_queue_init (ev_async_queue *q, ev_async *w, unsigned int size)
+{
+  unsigned int i, cells = 1;
+
+  while (cells < size)
+    cells <<= 1;
+
+  q->cells = (struct ev_async_cell *)ev_malloc (sizeof (struct ev_async_cell) * cells);
+  q->async = w;
+  q->mask  = cells - 1;
+  q->head  = 0;
+  q->tail  = 0;
+  q->count = 0;
+
+  for (i = 0; i < cells; ++i)
+    q->cells [i].seq = i;
+}
+
+void
+ev_async_queue_destroy (ev_async_queue *q)
+{
+  ev_free (q->cells);
+  q->cells = 0;
+}
+
+int
+ev_async_queue_push (EV_P_ ev_async_queue *q, void *msg)
+{
+  struct ev_async_cell *cell;
+  unsigned int pos;
+  int wakeup;
+
+  for (;;)
+    {
+      int dif;
+
+      pos  = q->tail;
+      cell = q->cells + (pos & q->mask);
+      dif  = (int)(cell->seq - pos);
+
+      if (expect_true (!dif))
+        {
+          if (EV_ATOMIC_CAS (&q->tail, pos, pos + 1))
+            break;
+        }
+      else if (dif < 0)
+        return 0; /* the consumer hasn't freed this cell yet, so we are full */
+    }
+
+  wakeup = !EV_ATOMIC_ADD (&q->count, 1);
+
+  cell->msg = msg;
+  ECB_MEMORY_FENCE_RELEASE; /* make sure msg is visible before the cell is */
+  cell->seq = pos + 1;
+
+  if (wakeup)
+    ev_async_send (EV_A_ q->async);
+
+  return 1;
+}
+
+unsigned int
+ev_async_queue_drain (EV_P_ ev_async_queue *q, void **msgs, unsigned int max)
+{
+  unsigned int cnt = 0;
+
+  while (cnt < max)
+    {
+      unsigned int got = 0, i;
+
+      /* take everything that is ready, then account for it in one go */
+      while (cnt + got < max)
+        {
+          struct ev_async_cell *cell = q->cells + ((q->head + got) & q->mask);
+
+          if (cell->seq != q->head + got + 1)
+            break;
+
+          ECB_MEMORY_FENCE_ACQUIRE;
+          msgs [cnt + got] = cell->msg;
+          ++got;
+        }
+
+      if (!got)
+        break; /* a producer claimed the next cell, but hasn't filled it yet */
+
+      ECB_MEMORY_FENCE; /* make sure we are done with the msgs before the cells are reused */
+
+      for (i = got; i--; )
+        {
+          q->cells [q->head & q->mask].seq = q->head + q->mask + 1;
+          ++q->head;
+        }
+
+      cnt += got;
+
+      /* when we took the last claimed cell, the next producer will signal us */
+      if (EV_ATOMIC_ADD (&q->count, -(int)got) == (int)got)
+        return cnt;
+    }
+
+  /* there are messages left, possibly not yet visible, so make sure we get invoked again */
+  ev_async_send (EV_A_ q->async);
+
+  return cnt;
+}
+#endif
 #endif
 
 /*****************************************************************************/
@@ -4294,8 +5947,49 @@ struct ev_once
   ev_timer to;
   void (*cb)(int revents, void *arg);
   void *arg;
+  struct ev_once *next; /* on the free list */
 };
 
+/* ev_once records are carved out of slabs of this many, which are */
+/* only returned to the allocator when the loop is destroyed */
+#define ONCE_SLAB 32
+
+struct ev_once_slab
+{
+  struct ev_once_slab *next;
+  struct ev_once once [ONCE_SLAB];
+};
+
+static void noinline
+once_grow (EV_P)
+{
+  struct ev_once_slab *slab = (struct ev_once_slab *)loop_malloc (sizeof (struct ev_once_slab));
+  int i;
+
+  slab->next = once_slabs;
+  once_slabs = slab;
+
+  for (i = ONCE_SLAB; i--; )
+    {
+      slab->once [i].next = once_free;
+      once_free = slab->once + i;
+    }
+}
+
+inline_speed struct ev_once *
+once_alloc (EV_P)
+{
+  struct ev_once *once;
+
+  if (expect_false (!once_free))
+    once_grow (EV_A);
+
+  once = once_free;
+  once_free = once->next;
+
+  return once;
+}
+
 static void
 once_cb (EV_P_ struct ev_once *once, int revents)
 {
@@ -4304,11 +5998,27 @@ once_cb (EV_P_ struct ev_once *once, int revents)
 
   ev_io_stop    (EV_A_ &once->io);
   ev_timer_stop (EV_A_ &once->to);
-  ev_free (once);
+
+  once->next = once_free;
+  once_free = once;
 
   cb (revents, arg);
 }
 
+static void
+once_destroy (EV_P)
+{
+  once_free = 0;
+
+  while (once_slabs)
+    {
+      struct ev_once_slab *slab = once_slabs;
+
+      once_slabs = slab->next;
+      loop_free (slab);
+    }
+}
+
 static void
 once_cb_io (EV_P_ ev_io *w, int revents)
 {
@@ -4328,13 +6038,7 @@ once_cb_to (EV_P_ ev_timer *w, int revents)
 void
 ev_once (EV_P_ int fd, int events, ev_tstamp timeout, void (*cb)(int revents, void *arg), void *arg)
 {
-  struct ev_once *once = (struct ev_once *)ev_malloc (sizeof (struct ev_once));
-
-  if (expect_false (!once))
-    {
-      cb (EV_ERROR | EV_READ | EV_WRITE | EV_TIMER, arg);
-      return;
-    }
+  struct ev_once *once = once_alloc (EV_A);
 
   once->cb  = cb;
   once->arg = arg;
@@ -4365,7 +6069,10 @@ ev_walk (EV_P_ int types, void (*cb)(EV_P_ int type, void *w))
 
   if (types & (EV_IO | EV_EMBED))
     for (i = 0; i < anfdmax; ++i)
-      for (wl = anfds [i].head; wl; )
+      if (expect_false (!ANFD_PRESENT (i)))
+        i |= ANFD_PAGE_MASK;
+      else
+      for (wl = ANFD_AT (i)->head; wl; )
         {
           wn = wl->next;
 
@@ -4393,20 +6100,36 @@ ev_walk (EV_P_ int types, void (*cb)(EV_P_ int type, void *w))
     for (i = timercnt + HEAP0; i-- > HEAP0; )
 #if EV_STAT_ENABLE
       /*TODO: timer is not always active*/
-      if (ev_cb ((ev_timer *)ANHE_w (timers [i])) == stat_timer_cb)
+      if (ev_cb ((ev_timer *)HEAP_w (timers, i)) == stat_timer_cb)
         {
           if (types & EV_STAT)
-            cb (EV_A_ EV_STAT, ((char *)ANHE_w (timers [i])) - offsetof (struct ev_stat, timer));
+            cb (EV_A_ EV_STAT, ((char *)HEAP_w (timers, i)) - offsetof (struct ev_stat, timer));
         }
       else
 #endif
       if (types & EV_TIMER)
-        cb (EV_A_ EV_TIMER, ANHE_w (timers [i]));
+        cb (EV_A_ EV_TIMER, HEAP_w (timers, i));
+
+#if EV_USE_TIMER_WHEEL
+  if (types & (EV_TIMER | EV_STAT))
+    for (i = twnodecnt + 1; --i; )
+      if (twnodes [i].w)
+#if EV_STAT_ENABLE
+        if (ev_cb ((ev_timer *)twnodes [i].w) == stat_timer_cb)
+          {
+            if (types & EV_STAT)
+              cb (EV_A_ EV_STAT, ((char *)twnodes [i].w) - offsetof (struct ev_stat, timer));
+          }
+        else
+#endif
+        if (types & EV_TIMER)
+          cb (EV_A_ EV_TIMER, twnodes [i].w);
+#endif
 
 #if EV_PERIODIC_ENABLE
   if (types & EV_PERIODIC)
     for (i = periodiccnt + HEAP0; i-- > HEAP0; )
-      cb (EV_A_ EV_PERIODIC, ANHE_w (periodics [i]));
+      cb (EV_A_ EV_PERIODIC, HEAP_w (periodics, i));
 #endif
 
 #if EV_IDLE_ENABLE
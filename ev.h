@@ -131,6 +131,10 @@ EV_CPP(extern "C" {)
 # define EV_WALK_ENABLE 0 /* not yet */
 #endif
 
+#ifndef EV_USE_NSEC
+# define EV_USE_NSEC 0
+#endif
+
 /*****************************************************************************/
 
 #if EV_CHILD_ENABLE && !EV_SIGNAL_ENABLE
@@ -198,6 +202,31 @@ struct ev_loop;
 
 /*****************************************************************************/
 
+/* the internal representation of time, also used for the private "at" */
+/* member of timers and periodics: integer nanoseconds with EV_USE_NSEC */
+#if EV_USE_NSEC
+typedef long long ev_time_t;
+
+/* round to nanoseconds, clamped to +-4e9 seconds to avoid overflow */
+EV_INLINE ev_time_t
+ev_time_from_ts (ev_tstamp ts)
+{
+  return ts >  4e9 ?  4000000000000000000LL
+       : ts < -4e9 ? -4000000000000000000LL
+       : (ev_time_t)(ts * 1e9 + (ts < 0. ? -.5 : .5));
+}
+
+# define EV_TIME_FROM_TS(ts) ev_time_from_ts (ts)
+# define EV_TIME_TO_TS(t)    ((ev_tstamp)(t) * 1e-9)
+#else
+typedef ev_tstamp ev_time_t;
+
+# define EV_TIME_FROM_TS(ts) (ts)
+# define EV_TIME_TO_TS(t)    (t)
+#endif
+
+/*****************************************************************************/
+
 #define EV_VERSION_MAJOR 4
 #define EV_VERSION_MINOR 11
 
@@ -207,6 +236,8 @@ enum {
   EV_NONE     =       0x00, /* no events */
   EV_READ     =       0x01, /* ev_io detected read will not block */
   EV_WRITE    =       0x02, /* ev_io detected write will not block */
+  EV_EXCLUSIVE =      0x20, /* ev_io wants wakeups not shared with other loops, if possible */
+  EV_ET       =       0x40, /* ev_io wants edge-triggered notifications, if possible */
   EV__IOFDSET =       0x80, /* internal use only */
   EV_IO       =    EV_READ, /* alias for type-detection */
   EV_TIMER    = 0x00000100, /* timer timed out */
@@ -280,7 +311,7 @@ enum {
 
 #define EV_WATCHER_TIME(type)			\
   EV_WATCHER (type)				\
-  ev_tstamp at;     /* private */
+  ev_time_t at;     /* private */
 
 /* base class, nothing to see here unless you subclass */
 typedef struct ev_watcher
@@ -450,6 +481,18 @@ typedef struct ev_async
 } ev_async;
 
 # define ev_async_pending(w) (+(w)->sent)
+
+/* a bounded multi-producer, single-consumer queue of pointers */
+/* that signals an ev_async watcher when it becomes non-empty */
+typedef struct ev_async_queue
+{
+  struct ev_async_cell *cells; /* private */
+  ev_async *async; /* private */
+  unsigned int mask; /* private */
+  unsigned int head; /* private, only used by the consumer */
+  unsigned int volatile tail; /* private */
+  int volatile count; /* private */
+} ev_async_queue;
 #endif
 
 /* the presence of this union forces similar struct layout */
@@ -492,13 +535,15 @@ enum {
   /* flag bits */
   EVFLAG_NOENV     = 0x01000000U, /* do NOT consult environment */
   EVFLAG_FORKCHECK = 0x02000000U, /* check for a fork in each iteration */
+  EVFLAG_FIFO      = 0x04000000U, /* invoke pending watchers of the same priority in fifo order */
   /* debugging/feature disable */
   EVFLAG_NOINOTIFY = 0x00100000U, /* do not attempt to use inotify */
 #if EV_COMPAT3
   EVFLAG_NOSIGFD   = 0, /* compatibility to pre-3.9 */
 #endif
   EVFLAG_SIGNALFD  = 0x00200000U, /* attempt to use signalfd */
-  EVFLAG_NOSIGMASK = 0x00400000U  /* avoid modifying the signal mask */
+  EVFLAG_NOSIGMASK = 0x00400000U, /* avoid modifying the signal mask */
+  EVFLAG_BUSYPOLL  = 0x00800000U  /* poll without blocking for a while before blocking */
 };
 
 /* method bits to be ored together */
@@ -509,7 +554,8 @@ enum {
   EVBACKEND_KQUEUE  = 0x00000008U, /* bsd */
   EVBACKEND_DEVPOLL = 0x00000010U, /* solaris 8 */ /* NYI */
   EVBACKEND_PORT    = 0x00000020U, /* solaris 10 */
-  EVBACKEND_ALL     = 0x0000003FU, /* all known backends */
+  EVBACKEND_IOURING = 0x00000040U, /* linux >= 5.11 */
+  EVBACKEND_ALL     = 0x0000007FU, /* all known backends */
   EVBACKEND_MASK    = 0x0000FFFFU  /* all future backends */
 };
 
@@ -642,12 +688,69 @@ EV_API_DECL void ev_unref (EV_P);
 EV_API_DECL void ev_once (EV_P_ int fd, int events, ev_tstamp timeout, void (*cb)(int revents, void *arg), void *arg);
 
 # if EV_FEATURE_API
+/* log2 histograms, bucket 0 counts zero, bucket n counts [2**(n-1), 2**n) */
+#define EV_STATS_BUCKETS 32
+
+/* callback classes for the per-callback statistics, derived from the revents */
+enum {
+  EV_CLASS_IO, EV_CLASS_TIMER, EV_CLASS_PERIODIC, EV_CLASS_SIGNAL,
+  EV_CLASS_CHILD, EV_CLASS_STAT, EV_CLASS_IDLE, EV_CLASS_PREPARE,
+  EV_CLASS_CHECK, EV_CLASS_EMBED, EV_CLASS_FORK, EV_CLASS_CLEANUP,
+  EV_CLASS_ASYNC, EV_CLASS_OTHER,
+  EV_CLASSES
+};
+
+struct ev_loop_stats
+{
+  unsigned long poll_count;      /* number of times the backend was polled */
+  unsigned long poll_events;     /* number of fd events the backend returned */
+  unsigned long fd_changes;      /* number of fds that needed reification */
+  unsigned long timers_fired;    /* number of ev_timer expiries */
+  unsigned long periodics_fired; /* number of ev_periodic expiries */
+  unsigned long invoked [EV_MAXPRI - EV_MINPRI + 1]; /* callbacks invoked by ev_invoke_pending, per priority */
+  unsigned long poll_events_hist [EV_STATS_BUCKETS]; /* polls by number of events */
+  unsigned long spin_hits;       /* busy polls that found events before blocking */
+  unsigned long spin_blocks;     /* busy polls that found nothing and blocked afterwards */
+  unsigned long budget_hits;     /* ev_invoke_pending calls that ran out of budget */
+  unsigned long time_budget_hits;/* those of them that ran out of time */
+  unsigned long deferred;        /* watchers deferred to the next iteration because of that */
+  unsigned long shrinks;         /* internal arrays shrunk after a load spike */
+  unsigned long shrunk;          /* bytes given back by that */
+
+  /* the following are only collected when enabled with ev_loop_stats_timing */
+  ev_tstamp blocked;             /* total time spent waiting for events */
+  ev_tstamp invoking;            /* total time spent in callbacks after polling */
+  unsigned long blocked_hist  [EV_STATS_BUCKETS]; /* polls by microseconds blocked */
+  unsigned long invoking_hist [EV_STATS_BUCKETS]; /* iterations by microseconds in callbacks */
+
+  /* the following are only collected when callbacks are timed individually */
+  unsigned long cb_count [EV_CLASSES]; /* number of timed callbacks */
+  ev_tstamp     cb_time  [EV_CLASSES]; /* total time spent in them */
+  ev_tstamp     cb_max   [EV_CLASSES]; /* longest single callback */
+  unsigned long cb_hist  [EV_CLASSES][EV_STATS_BUCKETS]; /* callbacks by microseconds */
+};
+
+EV_API_DECL void ev_loop_stats        (EV_P_ struct ev_loop_stats *stats); /* copy the loop statistics */
+EV_API_DECL void ev_loop_stats_reset  (EV_P); /* set all statistics to zero */
+EV_API_DECL void ev_loop_stats_timing (EV_P_ int enable); /* collect timing data and histograms, default off */
+EV_API_DECL void ev_loop_stats_callbacks (EV_P_ int enable); /* time every callback, default off */
+EV_API_DECL void ev_set_slow_cb (EV_P_ ev_tstamp threshold, void (*cb)(EV_P_ void *w, int revents, ev_tstamp elapsed)); /* report callbacks taking this long */
+
 EV_API_DECL unsigned int ev_iteration (EV_P); /* number of loop iterations */
 EV_API_DECL unsigned int ev_depth     (EV_P); /* #ev_loop enters - #ev_loop leaves */
+EV_API_DECL unsigned int ev_fdchange_elided (EV_P); /* number of fd changes not passed to the kernel */
+EV_API_DECL unsigned int ev_exclusive_count (EV_P); /* number of events received for EV_EXCLUSIVE fds */
 EV_API_DECL void         ev_verify    (EV_P); /* abort if loop data corrupted */
 
 EV_API_DECL void ev_set_io_collect_interval (EV_P_ ev_tstamp interval); /* sleep at least this time, default 0 */
+EV_API_DECL void ev_set_io_collect_adaptive (EV_P_ ev_tstamp max); /* adapt the io collect interval to the load, up to max */
 EV_API_DECL void ev_set_timeout_collect_interval (EV_P_ ev_tstamp interval); /* sleep at least this time, default 0 */
+EV_API_DECL void ev_set_busy_poll (EV_P_ ev_tstamp spin); /* poll without blocking this long before blocking */
+EV_API_DECL void ev_set_loop_allocator (EV_P_ void *(*cb)(EV_P_ void *ptr, long size)); /* allocate the loop's internal arrays and ev_once records with this, before starting watchers */
+EV_API_DECL void ev_set_shrink_interval (EV_P_ unsigned int iterations); /* try to shrink internal arrays every this many iterations, 0 disables */
+EV_API_DECL void ev_set_invoke_budget (EV_P_ unsigned int callbacks); /* invoke at most this many callbacks per iteration, default 0 (unlimited) */
+EV_API_DECL void ev_set_invoke_time_budget (EV_P_ ev_tstamp interval); /* stop invoking callbacks after this long per iteration, default 0 (unlimited) */
+EV_API_DECL void ev_set_timer_slack (EV_P_ ev_tstamp fraction, ev_tstamp max); /* let timers expire this much later, default 0 */
 
 /* advanced stuff for threading etc. support, see docs */
 EV_API_DECL void ev_set_userdata (EV_P_ void *data);
@@ -677,7 +780,7 @@ EV_API_DECL void ev_resume  (EV_P);
 } while (0)
 
 #define ev_io_set(ev,fd_,events_)            do { (ev)->fd = (fd_); (ev)->events = (events_) | EV__IOFDSET; } while (0)
-#define ev_timer_set(ev,after_,repeat_)      do { ((ev_watcher_time *)(ev))->at = (after_); (ev)->repeat = (repeat_); } while (0)
+#define ev_timer_set(ev,after_,repeat_)      do { ((ev_watcher_time *)(ev))->at = EV_TIME_FROM_TS (after_); (ev)->repeat = (repeat_); } while (0)
 #define ev_periodic_set(ev,ofs_,ival_,rcb_)  do { (ev)->offset = (ofs_); (ev)->interval = (ival_); (ev)->reschedule_cb = (rcb_); } while (0)
 #define ev_signal_set(ev,signum_)            do { (ev)->signum = (signum_); } while (0)
 #define ev_child_set(ev,pid_,trace_)         do { (ev)->pid = (pid_); (ev)->flags = !!(trace_); } while (0)
@@ -717,7 +820,7 @@ EV_API_DECL void ev_resume  (EV_P);
 # define ev_set_priority(ev,pri)             (   (ev_watcher *)(void *)(ev))->priority = (pri)
 #endif
 
-#define ev_periodic_at(ev)                   (+((ev_watcher_time *)(ev))->at)
+#define ev_periodic_at(ev)                   EV_TIME_TO_TS (+((ev_watcher_time *)(ev))->at)
 
 #ifndef ev_set_cb
 # define ev_set_cb(ev,cb_)                   ev_cb (ev) = (cb_)
@@ -808,6 +911,11 @@ EV_API_DECL void ev_embed_sweep    (EV_P_ ev_embed *w);
 EV_API_DECL void ev_async_start    (EV_P_ ev_async *w);
 EV_API_DECL void ev_async_stop     (EV_P_ ev_async *w);
 EV_API_DECL void ev_async_send     (EV_P_ ev_async *w);
+
+EV_API_DECL void ev_async_queue_init    (ev_async_queue *q, ev_async *w, unsigned int size);
+EV_API_DECL void ev_async_queue_destroy (ev_async_queue *q);
+EV_API_DECL int  ev_async_queue_push    (EV_P_ ev_async_queue *q, void *msg); /* thread-safe, returns 0 when full */
+EV_API_DECL unsigned int ev_async_queue_drain (EV_P_ ev_async_queue *q, void **msgs, unsigned int max); /* loop thread only */
 # endif
 
 #if EV_COMPAT3
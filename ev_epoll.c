@@ -67,11 +67,46 @@
 
 #define EV_EMASK_EPERM 0x80
 
+/* linux 4.5+, but the headers might be older */
+#ifndef EPOLLEXCLUSIVE
+# define EPOLLEXCLUSIVE (1U << 28)
+#endif
+
+/* epoll_pwait2 (linux 5.11+) takes a timespec instead of milliseconds, */
+/* which gets sub-millisecond timers right without waking up early */
+#include <sys/syscall.h>
+#ifdef SYS_epoll_pwait2
+# define EV_EPOLL_PWAIT2 1
+#else
+# define EV_EPOLL_PWAIT2 0
+#endif
+
+#if EV_EPOLL_PWAIT2
+/* the kernel always uses 64 bit members here */
+struct epoll_timespec
+{
+  long long tv_sec, tv_nsec;
+};
+
+inline_size int
+epoll_pwait2_call (EV_P_ ev_tstamp timeout)
+{
+  struct epoll_timespec ts;
+
+  EV_TS_SET (ts, timeout);
+  return syscall (SYS_epoll_pwait2, backend_fd, epoll_events, epoll_eventmax, &ts, 0, 0);
+}
+#endif
+
 static void
 epoll_modify (EV_P_ int fd, int oev, int nev)
 {
   struct epoll_event ev;
-  unsigned char oldmask;
+  unsigned char oldmask = ANFD_AT (fd)->emask;
+  unsigned char noexcl = oldmask & EV_EMASK_NOEXCL;
+  int op;
+
+  oldmask &= ~EV_EMASK_NOEXCL;
 
   /*
    * we handle EPOLL_CTL_DEL by ignoring it here
@@ -80,22 +115,63 @@ epoll_modify (EV_P_ int fd, int oev, int nev)
    * event in epoll_poll.
    * if the fd is added again, we try to ADD it, and, if that
    * fails, we assume it still has the same eventmask.
+   * exclusive registrations are the exception: the kernel might
+   * wake only this loop for an event that other loops wait for,
+   * and we would drop it, so they are deleted right away.
    */
   if (!nev)
-    return;
+    {
+      if (expect_false (oldmask & EV_EXCLUSIVE))
+        {
+          epoll_ctl (backend_fd, EPOLL_CTL_DEL, fd, &ev);
+          ANFD_AT (fd)->emask = 0;
+        }
+      else
+        ++fdchange_elided;
+
+      return;
+    }
 
-  oldmask = anfds [fd].emask;
-  anfds [fd].emask = nev;
+  /* the kernel refused EV_EXCLUSIVE for this fd before, don't ask again */
+  if (expect_false (noexcl))
+    nev &= ~EV_EXCLUSIVE;
+
+  ANFD_AT (fd)->emask = nev | noexcl;
 
   /* store the generation counter in the upper 32 bits, the fd in the lower 32 bits */
   ev.data.u64 = (uint64_t)(uint32_t)fd
-              | ((uint64_t)(uint32_t)++anfds [fd].egen << 32);
+              | ((uint64_t)(uint32_t)++ANFD_AT (fd)->egen << 32);
   ev.events   = (nev & EV_READ  ? EPOLLIN  : 0)
-              | (nev & EV_WRITE ? EPOLLOUT : 0);
+              | (nev & EV_WRITE ? EPOLLOUT : 0)
+              | (nev & EV_ET    ? EPOLLET  : 0)
+              | (nev & EV_EXCLUSIVE ? EPOLLEXCLUSIVE : 0);
+
+  /* a MOD also re-arms edge-triggered fds, which is needed when we dropped an event */
+  op = oev && (oldmask != nev || nev & EV_ET) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  if (expect_false ((oldmask | nev) & EV_EXCLUSIVE))
+    {
+      /* exclusive registrations cannot be modified, only deleted and re-added */
+      if (oldmask)
+        epoll_ctl (backend_fd, EPOLL_CTL_DEL, fd, &ev);
+
+      op = EPOLL_CTL_ADD;
+    }
 
-  if (expect_true (!epoll_ctl (backend_fd, oev && oldmask != nev ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev)))
+  if (expect_true (!epoll_ctl (backend_fd, op, fd, &ev)))
     return;
 
+  if (expect_false (errno == EINVAL && ev.events & EPOLLEXCLUSIVE))
+    {
+      /* the kernel doesn't support it, or not for this fd, so go without */
+      nev &= ~EV_EXCLUSIVE;
+      ANFD_AT (fd)->emask = nev | EV_EMASK_NOEXCL;
+      ev.events &= ~EPOLLEXCLUSIVE;
+
+      if (!epoll_ctl (backend_fd, EPOLL_CTL_ADD, fd, &ev))
+        return;
+    }
+
   if (expect_true (errno == ENOENT))
     {
       /* if ENOENT then the fd went away, so try to do the right thing */
@@ -119,7 +195,7 @@ epoll_modify (EV_P_ int fd, int oev, int nev)
     {
       /* EPERM means the fd is always ready, but epoll is too snobbish */
       /* to handle it, unlike select or poll. */
-      anfds [fd].emask = EV_EMASK_EPERM;
+      ANFD_AT (fd)->emask = EV_EMASK_EPERM;
 
       /* add fd to epoll_eperms, if not already inside */
       if (!(oldmask & EV_EMASK_EPERM))
@@ -131,11 +207,13 @@ epoll_modify (EV_P_ int fd, int oev, int nev)
       return;
     }
 
+  /* the kernel doesn't watch the fd, so don't let fd_reify assume it does */
+  ANFD_AT (fd)->emask = 0;
   fd_kill (EV_A_ fd);
 
 dec_egen:
   /* we didn't successfully call epoll_ctl, so decrement the generation counter again */
-  --anfds [fd].egen;
+  --ANFD_AT (fd)->egen;
 }
 
 static void
@@ -150,7 +228,12 @@ epoll_poll (EV_P_ ev_tstamp timeout)
   /* epoll wait times cannot be larger than (LONG_MAX - 999UL) / HZ msecs, which is below */
   /* the default libev max wait time, however. */
   EV_RELEASE_CB;
-  eventcnt = epoll_wait (backend_fd, epoll_events, epoll_eventmax, timeout * 1e3);
+#if EV_EPOLL_PWAIT2
+  if (expect_true (epoll_use_pwait2))
+    eventcnt = epoll_pwait2_call (EV_A_ timeout);
+  else
+#endif
+  eventcnt = epoll_wait (backend_fd, epoll_events, epoll_eventmax, EV_TS_TO_MSEC (timeout));
   EV_ACQUIRE_CB;
 
   if (expect_false (eventcnt < 0))
@@ -166,26 +249,46 @@ epoll_poll (EV_P_ ev_tstamp timeout)
       struct epoll_event *ev = epoll_events + i;
 
       int fd = (uint32_t)ev->data.u64; /* mask out the lower 32 bits */
-      int want = anfds [fd].events;
       int got  = (ev->events & (EPOLLOUT | EPOLLERR | EPOLLHUP) ? EV_WRITE : 0)
                | (ev->events & (EPOLLIN  | EPOLLERR | EPOLLHUP) ? EV_READ  : 0);
+      ANFD *anfd;
+      int want;
 
       /*
        * check for spurious notification.
        * this only finds spurious notifications on egen updates
        * other spurious notifications will be found by epoll_ctl, below
-       * we assume that fd is always in range, as we never shrink the anfds array
+       * an fd out of range can only come from a registration we couldn't
+       * remove before loop_shrink dropped the fd, so treat it the same way
        */
-      if (expect_false ((uint32_t)anfds [fd].egen != (uint32_t)(ev->data.u64 >> 32)))
+      if (expect_false (!ANFD_VALID (fd) || (uint32_t)ANFD_AT (fd)->egen != (uint32_t)(ev->data.u64 >> 32)))
         {
           /* recreate kernel state */
           postfork = 1;
           continue;
         }
 
+      anfd = ANFD_AT (fd);
+      want = anfd->events;
+
+      if (expect_false (anfd->emask & EV_EMASK_NOEXCL))
+        want &= ~EV_EXCLUSIVE;
+
+      if (expect_false (anfd->emask & EV_EXCLUSIVE))
+        ++exclusive_count;
+
       if (expect_false (got & ~want))
         {
-          anfds [fd].emask = want;
+          int op = want ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+
+          /* exclusive registrations cannot be modified, only deleted and re-added */
+          if (expect_false (anfd->emask & EV_EXCLUSIVE) && want)
+            {
+              epoll_ctl (backend_fd, EPOLL_CTL_DEL, fd, ev);
+              op = EPOLL_CTL_ADD;
+            }
+
+          anfd->emask = want | (anfd->emask & EV_EMASK_NOEXCL);
 
           /*
            * we received an event but are not interested in it, try mod or del
@@ -197,11 +300,13 @@ epoll_poll (EV_P_ ev_tstamp timeout)
            * but we closed it).
            */
           ev->events = (want & EV_READ  ? EPOLLIN  : 0)
-                     | (want & EV_WRITE ? EPOLLOUT : 0);
+                     | (want & EV_WRITE ? EPOLLOUT : 0)
+                     | (want & EV_ET    ? EPOLLET  : 0)
+                     | (want & EV_EXCLUSIVE ? EPOLLEXCLUSIVE : 0);
 
           /* pre-2.6.9 kernels require a non-null pointer with EPOLL_CTL_DEL, */
           /* which is fortunately easy to do for us. */
-          if (epoll_ctl (backend_fd, want ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, fd, ev))
+          if (epoll_ctl (backend_fd, op, fd, ev))
             {
               postfork = 1; /* an error occurred, recreate kernel state */
               continue;
@@ -223,15 +328,32 @@ epoll_poll (EV_P_ ev_tstamp timeout)
   for (i = epoll_epermcnt; i--; )
     {
       int fd = epoll_eperms [i];
-      unsigned char events = anfds [fd].events & (EV_READ | EV_WRITE);
+      unsigned char events = ANFD_AT (fd)->events & (EV_READ | EV_WRITE);
 
-      if (anfds [fd].emask & EV_EMASK_EPERM && events)
+      if (ANFD_AT (fd)->emask & EV_EMASK_EPERM && events)
         fd_event (EV_A_ fd, events);
       else
         epoll_eperms [i] = epoll_eperms [--epoll_epermcnt];
     }
 }
 
+/* remove an fd without watchers from the kernel, so loop_shrink can drop it */
+static int
+epoll_forget (EV_P_ int fd)
+{
+  struct epoll_event ev;
+
+  /* fds in epoll_eperms are only removed by epoll_poll */
+  if (ANFD_AT (fd)->emask & EV_EMASK_EPERM)
+    return 0;
+
+  /* fails if the fd has been closed, in which case the kernel forgot it already */
+  epoll_ctl (backend_fd, EPOLL_CTL_DEL, fd, &ev);
+  ANFD_AT (fd)->emask = 0;
+
+  return 1;
+}
+
 int inline_size
 epoll_init (EV_P_ int flags)
 {
@@ -254,6 +376,14 @@ epoll_init (EV_P_ int flags)
   epoll_eventmax = 64; /* initial number of events receivable per poll */
   epoll_events = (struct epoll_event *)ev_malloc (sizeof (struct epoll_event) * epoll_eventmax);
 
+#if EV_EPOLL_PWAIT2
+  /* an empty poll tells us whether the kernel has epoll_pwait2 */
+  epoll_use_pwait2 = epoll_pwait2_call (EV_A_ 0.) >= 0;
+
+  if (epoll_use_pwait2)
+    backend_mintime = 1e-9; /* hrtimers, so wait times are exact */
+#endif
+
   return EVBACKEND_EPOLL;
 }
 
@@ -0,0 +1,428 @@
+/*
+ * libev linux io_uring fd activity backend
+ *
+ * Copyright (c) 2007,2008,2009,2010,2011 Marc Alexander Lehmann <libev@schmorp.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modifica-
+ * tion, are permitted provided that the following conditions are met:
+ *
+ *   1.  Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *   2.  Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MER-
+ * CHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPE-
+ * CIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTH-
+ * ERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License ("GPL") version 2 or any later version,
+ * in which case the provisions of the GPL are applicable instead of
+ * the above. If you wish to allow the use of your version of this file
+ * only under the terms of the GPL and not to allow others to use your
+ * version of this file under the BSD license, indicate your decision
+ * by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL. If you do not delete the
+ * provisions above, a recipient may use your version of this file under
+ * either the BSD or the GPL.
+ */
+
+/*
+ * general notes about linux io_uring:
+ *
+ * a) poll requests are oneshot, so every delivered event needs a new
+ *    IORING_OP_POLL_ADD. we do this by queueing the fd for fd_reify with
+ *    EV__IOFDSET, which also coalesces it with any other change to the fd
+ *    in the same iteration.
+ * b) all poll additions and removals for an iteration are queued in the
+ *    submission ring and handed to the kernel together with the wait,
+ *    in a single io_uring_enter call, instead of one epoll_ctl per fd.
+ * c) removals are identified by the user_data of the original request,
+ *    not by fd, so we keep a generation counter per fd, just like the
+ *    epoll backend, and ignore completions from older generations.
+ * d) we need IORING_FEAT_NODROP (no lost completions on cq overflow) and
+ *    IORING_FEAT_EXT_ARG (timeout for io_uring_enter), both available from
+ *    linux 5.11 onwards. older kernels are rejected in iouring_init, so
+ *    loop_init can fall back to the next backend.
+ * e) like epoll, the kernel state does not survive a fork, and neither
+ *    do our mappings of the rings, so everything is recreated in the child.
+ */
+
+#include <sys/mman.h>
+#include <poll.h>
+
+/* initial and maximum number of submission queue entries */
+#define IOURING_INIT_ENTRIES 256
+#define IOURING_MAX_ENTRIES  32768
+
+/* user_data for requests whose completions we are not interested in */
+#define IOURING_IGNORE ((__u64)-1)
+
+/* the ring indices live in memory shared with the kernel, at offsets it tells us */
+#define EV_SQ_VAR(name) *(unsigned *)((char *)iouring_sq_ring + iouring_sq_ ## name)
+#define EV_CQ_VAR(name) *(unsigned *)((char *)iouring_cq_ring + iouring_cq_ ## name)
+#define EV_SQ_ARRAY     ((unsigned *)((char *)iouring_sq_ring + iouring_sq_array))
+#define EV_CQES         ((struct io_uring_cqe *)((char *)iouring_cq_ring + iouring_cq_cqes))
+
+/* glibc doesn't provide wrappers, and we don't want to depend on liburing */
+inline_size int
+evsys_io_uring_setup (unsigned entries, struct io_uring_params *params)
+{
+  return syscall (SYS_io_uring_setup, entries, params);
+}
+
+inline_size int
+evsys_io_uring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz)
+{
+  return syscall (SYS_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/*****************************************************************************/
+
+inline_speed void
+iouring_process_cqe (EV_P_ struct io_uring_cqe *cqe)
+{
+  int fd   = (uint32_t)cqe->user_data; /* the fd is in the lower 32 bits */
+  int res  = cqe->res;
+
+  if (cqe->user_data == IOURING_IGNORE)
+    return;
+
+  assert (("libev: io_uring fd must be in-bounds", fd >= 0 && fd < anfdmax));
+
+  /* a completion from an older generation means the fd has been modified since */
+  if ((uint32_t)ANFD_AT (fd)->egen != (uint32_t)(cqe->user_data >> 32))
+    return;
+
+  /* the request is gone, so the kernel no longer has anything armed */
+  ANFD_AT (fd)->emask = 0;
+
+  if (expect_false (res < 0))
+    {
+      /* the request was cancelled by our own removal, nothing to do */
+      if (res == -ECANCELED)
+        return;
+
+      /* EBADF means the fd was closed while being polled */
+      if (res != -EBADF)
+        {
+          errno = -res;
+          ev_syserr ("(libev) IORING_OP_POLL_ADD");
+        }
+
+      fd_kill (EV_A_ fd);
+      return;
+    }
+
+  fd_event (
+    EV_A_
+    fd,
+    (res & (POLLOUT | POLLERR | POLLHUP) ? EV_WRITE : 0)
+    | (res & (POLLIN | POLLERR | POLLHUP) ? EV_READ : 0)
+  );
+
+  /* poll requests are oneshot, so re-arm the fd: EV__IOFDSET makes */
+  /* fd_reify call iouring_modify even if the events didn't change, and */
+  /* with nothing armed, that only queues a fresh POLL_ADD */
+  fd_change (EV_A_ fd, EV__IOFDSET);
+}
+
+/* process all completions currently in the completion queue */
+static void
+iouring_reap (EV_P)
+{
+  unsigned head = EV_CQ_VAR (head);
+  unsigned tail = EV_CQ_VAR (tail);
+  unsigned mask = EV_CQ_VAR (ring_mask);
+
+  ECB_MEMORY_FENCE_ACQUIRE;
+
+  while (head != tail)
+    {
+      iouring_process_cqe (EV_A_ EV_CQES + (head & mask));
+      ++head;
+    }
+
+  ECB_MEMORY_FENCE_RELEASE;
+  EV_CQ_VAR (head) = head;
+}
+
+/*****************************************************************************/
+
+/* hand all queued sqes to the kernel, optionally waiting for completions */
+static int
+iouring_enter (EV_P_ ev_tstamp timeout)
+{
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  unsigned flags = 0;
+  unsigned min_complete = 0;
+  int res;
+
+  if (timeout > 0.)
+    {
+      EV_TS_SET (ts, timeout);
+
+      memset (&arg, 0, sizeof (arg));
+      arg.ts = (__u64)(uintptr_t)&ts;
+
+      flags        = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+      min_complete = 1;
+
+      EV_RELEASE_CB;
+    }
+
+  res = evsys_io_uring_enter (backend_fd, iouring_to_submit, min_complete, flags,
+                              flags ? &arg : 0, flags ? sizeof (arg) : 0);
+
+  if (timeout > 0.)
+    EV_ACQUIRE_CB;
+
+  /* the kernel always consumes all sqes unless the whole call fails */
+  if (expect_true (res >= 0))
+    iouring_to_submit = 0;
+
+  return res;
+}
+
+inline_speed struct io_uring_sqe *
+iouring_sqe_get (EV_P)
+{
+  unsigned tail = EV_SQ_VAR (tail);
+
+  if (expect_false (tail - EV_SQ_VAR (head) >= EV_SQ_VAR (ring_entries)))
+    {
+      /* the submission queue is full, flush it */
+      while (iouring_enter (EV_A_ 0.) < 0)
+        if (errno == EBUSY)
+          iouring_reap (EV_A); /* completion queue backlog, make room */
+        else if (errno != EINTR)
+          ev_syserr ("(libev) io_uring_enter");
+
+      tail = EV_SQ_VAR (tail);
+    }
+
+  {
+    struct io_uring_sqe *sqe = iouring_sqes + (tail & EV_SQ_VAR (ring_mask));
+    memset (sqe, 0, sizeof (*sqe));
+    return sqe;
+  }
+}
+
+inline_speed void
+iouring_sqe_submit (EV_P)
+{
+  /* the sq array is an identity mapping set up in iouring_internal_init, */
+  /* so all we have to do is to publish the new tail */
+  ECB_MEMORY_FENCE_RELEASE;
+  ++EV_SQ_VAR (tail);
+  ++iouring_to_submit;
+}
+
+/*****************************************************************************/
+
+static void
+iouring_modify (EV_P_ int fd, int oev, int nev)
+{
+  /* only remove what is actually armed - oneshot requests might have fired already */
+  if (ANFD_AT (fd)->emask)
+    {
+      struct io_uring_sqe *sqe = iouring_sqe_get (EV_A);
+
+      /* removal identifies the request by its user_data, so pass in the old generation */
+      sqe->opcode    = IORING_OP_POLL_REMOVE;
+      sqe->fd        = -1;
+      sqe->addr      = (__u64)(uint32_t)fd | ((__u64)(uint32_t)ANFD_AT (fd)->egen << 32);
+      sqe->user_data = IOURING_IGNORE;
+      iouring_sqe_submit (EV_A);
+
+      /* make sure events for the old request are ignored */
+      ++ANFD_AT (fd)->egen;
+    }
+
+  if (nev)
+    {
+      struct io_uring_sqe *sqe = iouring_sqe_get (EV_A);
+
+      sqe->opcode      = IORING_OP_POLL_ADD;
+      sqe->fd          = fd;
+      sqe->user_data   = (__u64)(uint32_t)fd | ((__u64)(uint32_t)ANFD_AT (fd)->egen << 32);
+      sqe->poll_events = (nev & EV_READ  ? POLLIN  : 0)
+                       | (nev & EV_WRITE ? POLLOUT : 0);
+      iouring_sqe_submit (EV_A);
+    }
+
+  /* the kernel has exactly this mask armed now */
+  ANFD_AT (fd)->emask = nev;
+}
+
+/*****************************************************************************/
+
+static void
+iouring_unmap (EV_P)
+{
+  if (iouring_sq_ring != MAP_FAILED) munmap (iouring_sq_ring, iouring_sq_ring_size);
+  if (iouring_cq_ring != MAP_FAILED) munmap (iouring_cq_ring, iouring_cq_ring_size);
+  if (iouring_sqes    != MAP_FAILED) munmap (iouring_sqes   , iouring_sqes_size   );
+}
+
+static void
+iouring_internal_destroy (EV_P)
+{
+  iouring_unmap (EV_A);
+
+  if (backend_fd >= 0)
+    {
+      close (backend_fd);
+      backend_fd = -1;
+    }
+}
+
+/* create the ring with iouring_entries entries and map it */
+static int
+iouring_internal_init (EV_P)
+{
+  struct io_uring_params params;
+  unsigned i;
+
+  memset (&params, 0, sizeof (params));
+
+  iouring_sq_ring = MAP_FAILED;
+  iouring_cq_ring = MAP_FAILED;
+  iouring_sqes    = (struct io_uring_sqe *)MAP_FAILED;
+  iouring_to_submit = 0;
+
+  backend_fd = evsys_io_uring_setup (iouring_entries, &params);
+
+  if (backend_fd < 0)
+    return -1;
+
+  /* we need completions not to be dropped, and a timeout for io_uring_enter */
+  if ((~params.features) & (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+    return -1;
+
+  iouring_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+  iouring_cq_ring_size = params.cq_off.cqes  + params.cq_entries * sizeof (struct io_uring_cqe);
+  iouring_sqes_size    =                       params.sq_entries * sizeof (struct io_uring_sqe);
+
+  iouring_sq_ring = mmap (0, iouring_sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, backend_fd, IORING_OFF_SQ_RING);
+  iouring_cq_ring = mmap (0, iouring_cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, backend_fd, IORING_OFF_CQ_RING);
+  iouring_sqes    = (struct io_uring_sqe *)mmap (0, iouring_sqes_size, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, backend_fd, IORING_OFF_SQES);
+
+  if (iouring_sq_ring == MAP_FAILED || iouring_cq_ring == MAP_FAILED || iouring_sqes == MAP_FAILED)
+    return -1;
+
+  iouring_sq_head         = params.sq_off.head;
+  iouring_sq_tail         = params.sq_off.tail;
+  iouring_sq_ring_mask    = params.sq_off.ring_mask;
+  iouring_sq_ring_entries = params.sq_off.ring_entries;
+  iouring_sq_array        = params.sq_off.array;
+
+  iouring_cq_head         = params.cq_off.head;
+  iouring_cq_tail         = params.cq_off.tail;
+  iouring_cq_ring_mask    = params.cq_off.ring_mask;
+  iouring_cq_overflow     = params.cq_off.overflow;
+  iouring_cq_cqes         = params.cq_off.cqes;
+
+  /* we always use sqes in ring order, so the indirection array is the identity */
+  for (i = 0; i < params.sq_entries; ++i)
+    EV_SQ_ARRAY [i] = i;
+
+  fcntl (backend_fd, F_SETFD, FD_CLOEXEC);
+
+  return 0;
+}
+
+/* recreate the ring and re-arm all fds, optionally with a bigger ring */
+static void
+iouring_recreate (EV_P)
+{
+  iouring_internal_destroy (EV_A);
+
+  while (iouring_internal_init (EV_A) < 0)
+    {
+      iouring_internal_destroy (EV_A);
+      ev_syserr ("(libev) io_uring_setup");
+    }
+
+  fd_rearm_all (EV_A);
+}
+
+static void
+iouring_poll (EV_P_ ev_tstamp timeout)
+{
+  /* if there are completions waiting already, there is no reason to block */
+  if (EV_CQ_VAR (head) != EV_CQ_VAR (tail))
+    timeout = 0.;
+
+  if (timeout > 0. || iouring_to_submit)
+    {
+      /* submits all fd changes and waits for events in one syscall */
+      int res = iouring_enter (EV_A_ timeout);
+
+      if (expect_false (res < 0))
+        {
+          /* EBUSY means the kernel has a completion backlog, which we reap below, */
+          /* ETIME is the normal timeout case */
+          if (errno != EINTR && errno != ETIME && errno != EBUSY)
+            ev_syserr ("(libev) io_uring_enter");
+        }
+    }
+
+  iouring_reap (EV_A);
+
+  /* the kernel should never drop completions with IORING_FEAT_NODROP, but if it */
+  /* ever does (it can on memory shortage), we lost events and have to start over */
+  if (expect_false (EV_CQ_VAR (overflow)))
+    {
+      if (iouring_entries < IOURING_MAX_ENTRIES)
+        iouring_entries <<= 1;
+
+      iouring_recreate (EV_A);
+    }
+}
+
+int inline_size
+iouring_init (EV_P_ int flags)
+{
+  iouring_entries = IOURING_INIT_ENTRIES;
+
+  if (iouring_internal_init (EV_A) < 0)
+    {
+      iouring_internal_destroy (EV_A);
+      return 0;
+    }
+
+  backend_mintime = 1e-9; /* the kernel uses hrtimers, so wait times are exact */
+  backend_modify  = iouring_modify;
+  backend_poll    = iouring_poll;
+
+  return EVBACKEND_IOURING;
+}
+
+void inline_size
+iouring_destroy (EV_P)
+{
+  /* ev_loop_destroy has already closed backend_fd */
+  iouring_unmap (EV_A);
+}
+
+void inline_size
+iouring_fork (EV_P)
+{
+  iouring_recreate (EV_A);
+}
+
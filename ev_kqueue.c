@@ -119,14 +119,14 @@ kqueue_poll (EV_P_ ev_tstamp timeout)
           int err = kqueue_events [i].data;
 
           /* we are only interested in errors for fds that we are interested in :) */
-          if (anfds [fd].events)
+          if (ANFD_AT (fd)->events)
             {
               if (err == ENOENT) /* resubmit changes on ENOENT */
-                kqueue_modify (EV_A_ fd, 0, anfds [fd].events);
+                kqueue_modify (EV_A_ fd, 0, ANFD_AT (fd)->events);
               else if (err == EBADF) /* on EBADF, we re-check the fd */
                 {
                   if (fd_valid (fd))
-                    kqueue_modify (EV_A_ fd, 0, anfds [fd].events);
+                    kqueue_modify (EV_A_ fd, 0, ANFD_AT (fd)->events);
                   else
                     fd_kill (EV_A_ fd);
                 }
@@ -179,7 +179,7 @@ void inline_size
 kqueue_destroy (EV_P)
 {
   ev_free (kqueue_events);
-  ev_free (kqueue_changes);
+  loop_free (kqueue_changes);
 }
 
 void inline_size
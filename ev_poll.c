@@ -90,9 +90,19 @@ poll_poll (EV_P_ ev_tstamp timeout)
 {
   struct pollfd *p;
   int res;
-  
+#if EV_USE_PPOLL
+  /* the kernel's idea of a timespec, which is not always the libc one */
+  struct { long tv_sec, tv_nsec; } ts;
+
+  EV_TS_SET (ts, timeout);
+#endif
+
   EV_RELEASE_CB;
-  res = poll (polls, pollcnt, timeout * 1e3);
+#if EV_USE_PPOLL
+  res = syscall (SYS_ppoll, polls, (unsigned int)pollcnt, &ts, 0, 0);
+#else
+  res = poll (polls, pollcnt, EV_TS_TO_MSEC (timeout));
+#endif
   EV_ACQUIRE_CB;
 
   if (expect_false (res < 0))
@@ -129,7 +139,11 @@ poll_poll (EV_P_ ev_tstamp timeout)
 int inline_size
 poll_init (EV_P_ int flags)
 {
+#if EV_USE_PPOLL
+  backend_mintime = 1e-9; /* ppoll takes a timespec, and linux uses hrtimers */
+#else
   backend_mintime = 1e-3;
+#endif
   backend_modify  = poll_modify;
   backend_poll    = poll_poll;
 
@@ -142,7 +156,7 @@ poll_init (EV_P_ int flags)
 void inline_size
 poll_destroy (EV_P)
 {
-  ev_free (pollidxs);
-  ev_free (polls);
+  loop_free (pollidxs);
+  loop_free (polls);
 }
 
@@ -0,0 +1,661 @@
+/*
+ * multi-loop thread pool, one event loop per thread
+ *
+ * Copyright (c) 2012 Marc Alexander Lehmann <libev@schmorp.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modifica-
+ * tion, are permitted provided that the following conditions are met:
+ *
+ *   1.  Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *   2.  Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MER-
+ * CHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPE-
+ * CIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTH-
+ * ERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License ("GPL") version 2 or any later version,
+ * in which case the provisions of the GPL are applicable instead of
+ * the above. If you wish to allow the use of your version of this file
+ * only under the terms of the GPL and not to allow others to use your
+ * version of this file under the BSD license, indicate your decision
+ * by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL. If you do not delete the
+ * provisions above, a recipient may use your version of this file under
+ * either the BSD or the GPL.
+ */
+
+#ifdef __linux__
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE /* for pthread_setaffinity_np */
+# endif
+# include <sched.h>
+#endif
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef EV_POOL_H
+# include EV_POOL_H
+#else
+# include "ev_pool.h"
+#endif
+
+/* the cpu set api needs _GNU_SOURCE, which is too late when embedded after ev.c */
+#ifndef EV_POOL_AFFINITY
+# ifdef CPU_SET
+#  define EV_POOL_AFFINITY 1
+# else
+#  define EV_POOL_AFFINITY 0
+# endif
+#endif
+
+#if EV_MULTIPLICITY && EV_ASYNC_ENABLE && EV_FEATURE_API
+
+#if __GNUC__ >= 4 || defined (__clang__)
+# define pool_cas(ptr,old,new) __sync_bool_compare_and_swap ((ptr), (old), (new))
+# define pool_add(ptr,n)       __sync_fetch_and_add ((ptr), (n))
+#else
+/* no atomic builtins, so serialise all updates with a single mutex */
+static pthread_mutex_t pool_atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+pool_cas_ (ev_pool_task *volatile *ptr, ev_pool_task *old, ev_pool_task *new_)
+{
+  int ok;
+
+  pthread_mutex_lock (&pool_atomic_lock);
+  ok = *ptr == old;
+  if (ok)
+    *ptr = new_;
+  pthread_mutex_unlock (&pool_atomic_lock);
+
+  return ok;
+}
+
+static unsigned long
+pool_add_ (volatile unsigned long *ptr, unsigned long n)
+{
+  unsigned long old;
+
+  pthread_mutex_lock (&pool_atomic_lock);
+  old = *ptr;
+  *ptr = old + n;
+  pthread_mutex_unlock (&pool_atomic_lock);
+
+  return old;
+}
+
+# define pool_cas(ptr,old,new) pool_cas_ ((ptr), (old), (new))
+# define pool_add(ptr,n)       pool_add_ ((ptr), (n))
+#endif
+
+/* per-loop data, reachable via ev_userdata */
+struct ev_pool_loop
+{
+  struct ev_loop *loop;
+  struct ev_pool *pool;
+  pthread_t tid;
+  pthread_mutex_t lock; /* held by the loop thread, except while it blocks */
+  ev_async async_w;     /* wakes up the loop for new tasks, watchers or shutdown */
+  int cpu;              /* cpu to bind the thread to, or -1 */
+  volatile int stopping;
+  volatile int sleeping; /* the loop is (about to be) blocked in the backend */
+
+  ev_pool_task *volatile inbox; /* submitted tasks, newest first */
+  volatile unsigned int load; /* smoothed number of pending watchers per iteration, times 16 */
+
+  /* spawned tasks, run by idle_w from the bottom, stolen from the top */
+  pthread_mutex_t dq_lock;
+  ev_pool_task **dq;
+  unsigned int dqmax; /* a power of two */
+  volatile unsigned int dqtop, dqbottom;
+  ev_idle idle_w;
+
+  struct ev_pool_stats stats;
+};
+
+struct ev_pool
+{
+  int count;
+  int started; /* number of running threads */
+  volatile int stealing;
+  volatile unsigned long next; /* round-robin counter */
+  struct ev_pool_loop *loops;
+};
+
+#define DQ_SIZE(pl) ((pl)->dqbottom - (pl)->dqtop)
+
+/* append a task to the bottom of the deque, returns false if out of memory */
+static int
+dq_push (struct ev_pool_loop *pl, ev_pool_task *task)
+{
+  pthread_mutex_lock (&pl->dq_lock);
+
+  if (DQ_SIZE (pl) == pl->dqmax)
+    {
+      unsigned int newmax = pl->dqmax ? pl->dqmax * 2 : 64;
+      ev_pool_task **dq = (ev_pool_task **)malloc (newmax * sizeof (ev_pool_task *));
+      unsigned int i;
+
+      if (!dq)
+        {
+          pthread_mutex_unlock (&pl->dq_lock);
+          return 0;
+        }
+
+      for (i = 0; i < pl->dqmax; ++i)
+        dq [i] = pl->dq [(pl->dqtop + i) & (pl->dqmax - 1)];
+
+      free (pl->dq);
+      pl->dq       = dq;
+      pl->dqbottom = pl->dqmax;
+      pl->dqtop    = 0;
+      pl->dqmax    = newmax;
+    }
+
+  pl->dq [pl->dqbottom & (pl->dqmax - 1)] = task;
+  ++pl->dqbottom;
+
+  pthread_mutex_unlock (&pl->dq_lock);
+
+  return 1;
+}
+
+/* take the most recently pushed task, for the owning loop */
+static ev_pool_task *
+dq_pop (struct ev_pool_loop *pl)
+{
+  ev_pool_task *task = 0;
+
+  pthread_mutex_lock (&pl->dq_lock);
+
+  if (DQ_SIZE (pl))
+    task = pl->dq [--pl->dqbottom & (pl->dqmax - 1)];
+
+  pthread_mutex_unlock (&pl->dq_lock);
+
+  return task;
+}
+
+/* take up to n of the oldest tasks, for a thief */
+static int
+dq_steal (struct ev_pool_loop *pl, ev_pool_task **tasks, unsigned int n)
+{
+  unsigned int i;
+
+  pthread_mutex_lock (&pl->dq_lock);
+
+  if (n > DQ_SIZE (pl))
+    n = DQ_SIZE (pl);
+
+  for (i = 0; i < n; ++i)
+    tasks [i] = pl->dq [pl->dqtop++ & (pl->dqmax - 1)];
+
+  pthread_mutex_unlock (&pl->dq_lock);
+
+  return n;
+}
+
+/* runs spawned tasks while the loop has nothing better to do */
+static void
+pool_idle_cb (EV_P_ ev_idle *w, int revents)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+  ev_pool_task *task = dq_pop (pl);
+
+  if (!task)
+    {
+      ev_idle_stop (EV_A_ w);
+      return;
+    }
+
+  /* only one task per iteration, so I/O is not delayed by more than that */
+  task->cb (EV_A_ task);
+  ++pl->stats.executed;
+}
+
+#define STEAL_MAX 64
+
+/* move half of the tasks of the busiest other loop to our deque */
+static void
+pool_steal (struct ev_pool_loop *pl)
+{
+  struct ev_pool *pool = pl->pool;
+  struct ev_pool_loop *victim = 0;
+  ev_pool_task *tasks [STEAL_MAX];
+  unsigned int size = 0;
+  int i, n;
+
+  for (i = 0; i < pool->count; ++i)
+    if (pool->loops + i != pl && DQ_SIZE (pool->loops + i) > size)
+      {
+        victim = pool->loops + i;
+        size = DQ_SIZE (victim);
+      }
+
+  if (!victim)
+    return;
+
+  n = dq_steal (victim, tasks, size / 2 < STEAL_MAX ? (size + 1) / 2 : STEAL_MAX);
+
+  if (!n)
+    return;
+
+  pool_add (&victim->stats.stolen, n);
+  ++pl->stats.steals;
+  pl->stats.steal_tasks += n;
+
+  /* push the oldest task last, so we run it first */
+  for (i = n; i--; )
+    if (!dq_push (pl, tasks [i]))
+      {
+        tasks [i]->cb (pl->loop, tasks [i]);
+        ++pl->stats.executed;
+      }
+
+  ev_idle_start (pl->loop, &pl->idle_w);
+}
+
+static void
+pool_release (EV_P)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  pl->sleeping = 1;
+  pthread_mutex_unlock (&pl->lock);
+}
+
+static void
+pool_acquire (EV_P)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  pthread_mutex_lock (&pl->lock);
+  pl->sleeping = 0;
+}
+
+/* keep track of the load before invoking the pending watchers as usual */
+/* and look for work in other loops when we have no tasks left ourselves */
+static void
+pool_invoke (EV_P)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  /* exponential moving average with a weight of 1/8 */
+  pl->load = pl->load - (pl->load >> 3) + (ev_pending_count (EV_A) << 1);
+
+  ev_invoke_pending (EV_A);
+
+  if (pl->pool->stealing && !DQ_SIZE (pl) && !pl->stopping)
+    pool_steal (pl);
+}
+
+/* runs all submitted tasks, returns how many */
+static int
+pool_run_inbox (struct ev_pool_loop *pl)
+{
+  ev_pool_task *list, *task = 0;
+  int n = 0;
+
+  /* take all submitted tasks at once, so we don't race with submitters */
+  do
+    list = pl->inbox;
+  while (!pool_cas (&pl->inbox, list, (ev_pool_task *)0));
+
+  /* the inbox is a stack, so reverse it to run tasks in submission order */
+  while (list)
+    {
+      ev_pool_task *next = list->next;
+      list->next = task;
+      task = list;
+      list = next;
+    }
+
+  while (task)
+    {
+      /* the callback may resubmit the task, so fetch next first */
+      ev_pool_task *next = task->next;
+
+      task->cb (pl->loop, task);
+      ++pl->stats.executed;
+      task = next;
+      ++n;
+    }
+
+  return n;
+}
+
+static void
+pool_async_cb (EV_P_ ev_async *w, int revents)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  pool_run_inbox (pl);
+
+  if (pl->stopping)
+    ev_break (EV_A_ EVBREAK_ALL);
+}
+
+static void *
+pool_run (void *arg)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)arg;
+
+#if EV_POOL_AFFINITY
+  if (pl->cpu >= 0)
+    {
+      cpu_set_t set;
+
+      CPU_ZERO (&set);
+      CPU_SET (pl->cpu, &set);
+      pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+    }
+#endif
+
+  pthread_mutex_lock (&pl->lock);
+  ev_run (pl->loop, 0);
+  pthread_mutex_unlock (&pl->lock);
+
+  return 0;
+}
+
+/* the cpu the index'th loop runs on: the index'th cpu we may run on, modulo their number */
+static int
+pool_cpu (int index)
+{
+#if EV_POOL_AFFINITY
+  cpu_set_t set;
+  int cpus, cpu;
+
+  if (sched_getaffinity (0, sizeof (set), &set) || !(cpus = CPU_COUNT (&set)))
+    return -1;
+
+  index %= cpus;
+
+  for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    if (CPU_ISSET (cpu, &set) && !index--)
+      return cpu;
+#endif
+
+  return -1;
+}
+
+/* stop and join all running loop threads, then free everything */
+static void
+pool_free (struct ev_pool *pool)
+{
+  int i, ran;
+
+  for (i = 0; i < pool->started; ++i)
+    {
+      struct ev_pool_loop *pl = pool->loops + i;
+
+      pl->stopping = 1;
+      ev_async_send (pl->loop, &pl->async_w);
+    }
+
+  for (i = 0; i < pool->started; ++i)
+    pthread_join (pool->loops [i].tid, 0);
+
+  /* the threads are gone, so run the remaining submitted and spawned */
+  /* tasks here. they might submit or spawn more, to any of the loops, */
+  /* so go on until a pass over all loops finds nothing left to run */
+  do
+    {
+      ran = 0;
+
+      for (i = 0; i < pool->count; ++i)
+        {
+          struct ev_pool_loop *pl = pool->loops + i;
+          ev_pool_task *task;
+
+          ran += pool_run_inbox (pl);
+
+          while ((task = dq_pop (pl)))
+            {
+              task->cb (pl->loop, task);
+              ++pl->stats.executed;
+              ++ran;
+            }
+        }
+    }
+  while (ran);
+
+  for (i = 0; i < pool->count; ++i)
+    {
+      struct ev_pool_loop *pl = pool->loops + i;
+
+      ev_idle_stop (pl->loop, &pl->idle_w);
+      ev_async_stop (pl->loop, &pl->async_w);
+      ev_loop_destroy (pl->loop);
+      pthread_mutex_destroy (&pl->lock);
+      pthread_mutex_destroy (&pl->dq_lock);
+      free (pl->dq);
+    }
+
+  free (pool->loops);
+  free (pool);
+}
+
+struct ev_pool *
+ev_pool_new (int loops, unsigned int flags, int affinity)
+{
+  struct ev_pool *pool;
+  int i;
+
+  if (loops <= 0)
+    loops = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (loops <= 0)
+    loops = 1;
+
+  pool = (struct ev_pool *)calloc (1, sizeof (struct ev_pool));
+  if (!pool)
+    return 0;
+
+  pool->loops = (struct ev_pool_loop *)calloc (loops, sizeof (struct ev_pool_loop));
+  if (!pool->loops)
+    {
+      free (pool);
+      return 0;
+    }
+
+  for (i = 0; i < loops; ++i)
+    {
+      struct ev_pool_loop *pl = pool->loops + i;
+
+      pl->loop = ev_loop_new (flags);
+      if (!pl->loop)
+        break;
+
+      ++pool->count;
+
+      pl->pool = pool;
+      pl->cpu  = affinity ? pool_cpu (i) : -1;
+      pthread_mutex_init (&pl->lock, 0);
+      pthread_mutex_init (&pl->dq_lock, 0);
+
+      ev_async_init (&pl->async_w, pool_async_cb);
+      ev_async_start (pl->loop, &pl->async_w);
+
+      /* spawned tasks must not delay any other watchers */
+      ev_idle_init (&pl->idle_w, pool_idle_cb);
+      ev_set_priority (&pl->idle_w, EV_MINPRI);
+
+      ev_set_userdata (pl->loop, pl);
+      ev_set_invoke_pending_cb (pl->loop, pool_invoke);
+      ev_set_loop_release_cb (pl->loop, pool_release, pool_acquire);
+    }
+
+  if (pool->count == loops)
+    for (i = 0; i < loops; ++i)
+      {
+        if (pthread_create (&pool->loops [i].tid, 0, pool_run, pool->loops + i))
+          break;
+
+        ++pool->started;
+      }
+
+  if (pool->started < loops)
+    {
+      pool_free (pool);
+      return 0;
+    }
+
+  return pool;
+}
+
+void
+ev_pool_destroy (struct ev_pool *pool)
+{
+  pool_free (pool);
+}
+
+int
+ev_pool_count (struct ev_pool *pool)
+{
+  return pool->count;
+}
+
+struct ev_loop *
+ev_pool_loop (struct ev_pool *pool, int index)
+{
+  return pool->loops [index].loop;
+}
+
+struct ev_loop *
+ev_pool_next (struct ev_pool *pool, int policy)
+{
+  int start = pool_add (&pool->next, 1) % pool->count;
+  int best = start;
+
+  if (policy == EV_POOL_LEASTLOADED)
+    {
+      unsigned long best_load = (unsigned long)-1;
+      int i;
+
+      /* start at the round-robin position, so ties are spread evenly */
+      for (i = 0; i < pool->count; ++i)
+        {
+          int idx = (start + i) % pool->count;
+          struct ev_pool_loop *pl = pool->loops + idx;
+          unsigned long queued = pl->stats.submitted + pl->stats.spawned + pl->stats.steal_tasks
+                                 - pl->stats.executed - pl->stats.stolen;
+          unsigned long load = pl->load + (queued << 4);
+
+          if (load < best_load)
+            {
+              best_load = load;
+              best = idx;
+            }
+        }
+    }
+
+  return pool->loops [best].loop;
+}
+
+void
+ev_pool_submit (EV_P_ ev_pool_task *task)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+  ev_pool_task *head;
+
+  /* count first, so submitted - executed never goes negative */
+  pool_add (&pl->stats.submitted, 1);
+
+  do
+    {
+      head = pl->inbox;
+      task->next = head;
+    }
+  while (!pool_cas (&pl->inbox, head, task));
+
+  ev_async_send (EV_A_ &pl->async_w);
+}
+
+void
+ev_pool_spawn (EV_P_ ev_pool_task *task)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+  struct ev_pool *pool = pl->pool;
+
+  ++pl->stats.spawned;
+
+  if (!dq_push (pl, task))
+    {
+      task->cb (EV_A_ task);
+      ++pl->stats.executed;
+      return;
+    }
+
+  ev_idle_start (EV_A_ &pl->idle_w);
+
+  /* we run one task ourselves, if there are more, wake up a sleeping loop to steal them */
+  if (pool->stealing && DQ_SIZE (pl) > 1)
+    {
+      int i;
+
+      for (i = 1; i < pool->count; ++i)
+        {
+          struct ev_pool_loop *other = pool->loops + (pl - pool->loops + i) % pool->count;
+
+          /* clearing sleeping is racy, but at worst wakes up another loop, too */
+          if (other->sleeping)
+            {
+              other->sleeping = 0;
+              ++pl->stats.wakeups;
+              ev_async_send (other->loop, &other->async_w);
+              break;
+            }
+        }
+    }
+}
+
+void
+ev_pool_stealing (struct ev_pool *pool, int enable)
+{
+  pool->stealing = !!enable;
+}
+
+void
+ev_pool_stats (EV_P_ struct ev_pool_stats *stats)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  *stats = pl->stats;
+}
+
+void
+ev_pool_lock (EV_P)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+  pthread_mutex_lock (&pl->lock);
+}
+
+void
+ev_pool_unlock (EV_P)
+{
+  struct ev_pool_loop *pl = (struct ev_pool_loop *)ev_userdata (EV_A);
+
+  /* wake up the loop, so it notices watcher changes */
+  ev_async_send (EV_A_ &pl->async_w);
+  pthread_mutex_unlock (&pl->lock);
+}
+
+#endif
+
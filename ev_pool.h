@@ -0,0 +1,108 @@
+/*
+ * multi-loop thread pool
+ *
+ * Copyright (c) 2012 Marc Alexander Lehmann <libev@schmorp.de>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modifica-
+ * tion, are permitted provided that the following conditions are met:
+ *
+ *   1.  Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *   2.  Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MER-
+ * CHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPE-
+ * CIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTH-
+ * ERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License ("GPL") version 2 or any later version,
+ * in which case the provisions of the GPL are applicable instead of
+ * the above. If you wish to allow the use of your version of this file
+ * only under the terms of the GPL and not to allow others to use your
+ * version of this file under the BSD license, indicate your decision
+ * by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL. If you do not delete the
+ * provisions above, a recipient may use your version of this file under
+ * either the BSD or the GPL.
+ */
+
+#ifndef EV_POOL_H_
+#define EV_POOL_H_
+
+#ifdef EV_H
+# include EV_H
+#else
+# include "ev.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a pool needs loop objects, ev_async for wakeups and the loop hooks */
+#if EV_MULTIPLICITY && EV_ASYNC_ENABLE && EV_FEATURE_API
+
+struct ev_pool;
+
+/* a function call submitted to a pool loop, invoked in that loop's thread */
+typedef struct ev_pool_task
+{
+  struct ev_pool_task *next; /* private */
+  void *data; /* rw */
+  void (*cb)(EV_P_ struct ev_pool_task *task); /* private */
+} ev_pool_task;
+
+#define ev_pool_task_init(task,cb_) do { (task)->cb = (cb_); } while (0)
+
+/* per-loop counters, all tasks are counted on the loop they were queued on, */
+/* except for executed, which counts tasks run by this loop */
+struct ev_pool_stats
+{
+  unsigned long submitted;   /* tasks submitted with ev_pool_submit */
+  unsigned long spawned;     /* tasks spawned with ev_pool_spawn */
+  unsigned long executed;    /* tasks run by this loop, including stolen ones */
+  unsigned long stolen;      /* spawned tasks other loops stole from this one */
+  unsigned long steals;      /* number of times this loop stole tasks */
+  unsigned long steal_tasks; /* tasks this loop stole from other loops */
+  unsigned long wakeups;     /* sleeping loops woken up to steal from this one */
+};
+
+/* loop selection policies for ev_pool_next */
+enum {
+  EV_POOL_ROUNDROBIN  = 0, /* each loop in turn */
+  EV_POOL_LEASTLOADED = 1  /* the loop with the fewest events and queued tasks */
+};
+
+EV_API_DECL struct ev_pool *ev_pool_new (int loops, unsigned int flags, int affinity); /* 0 on failure */
+EV_API_DECL void ev_pool_destroy (struct ev_pool *pool); /* stop all loops and wait for their threads */
+
+EV_API_DECL int ev_pool_count (struct ev_pool *pool);
+EV_API_DECL struct ev_loop *ev_pool_loop (struct ev_pool *pool, int index);
+EV_API_DECL struct ev_loop *ev_pool_next (struct ev_pool *pool, int policy);
+
+EV_API_DECL void ev_pool_submit (EV_P_ ev_pool_task *task); /* thread-safe */
+EV_API_DECL void ev_pool_spawn  (EV_P_ ev_pool_task *task); /* from the loop thread, may be stolen */
+EV_API_DECL void ev_pool_stealing (struct ev_pool *pool, int enable); /* let idle loops steal spawned tasks, default off */
+EV_API_DECL void ev_pool_stats  (EV_P_ struct ev_pool_stats *stats);
+EV_API_DECL void ev_pool_lock   (EV_P); /* lock a pool loop from another thread */
+EV_API_DECL void ev_pool_unlock (EV_P); /* unlock it and wake it up */
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
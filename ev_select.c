@@ -77,7 +77,7 @@ select_modify (EV_P_ int fd, int oev, int nev)
 #if EV_SELECT_USE_FD_SET
 
     #if EV_SELECT_IS_WINSOCKET
-    SOCKET handle = anfds [fd].handle;
+    SOCKET handle = ANFD_COLD_AT (fd)->handle;
     #else
     int handle = fd;
     #endif
@@ -139,12 +139,20 @@ select_modify (EV_P_ int fd, int oev, int nev)
 static void
 select_poll (EV_P_ ev_tstamp timeout)
 {
+#if EV_USE_PSELECT && !defined(_WIN32)
+  struct timespec tv;
+#else
   struct timeval tv;
+#endif
   int res;
   int fd_setsize;
 
   EV_RELEASE_CB;
+#if EV_USE_PSELECT && !defined(_WIN32)
+  EV_TS_SET (tv, timeout);
+#else
   EV_TV_SET (tv, timeout);
+#endif
 
 #if EV_SELECT_USE_FD_SET
   fd_setsize = sizeof (fd_set);
@@ -165,7 +173,14 @@ select_poll (EV_P_ ev_tstamp timeout)
   res = select (vec_max * NFDBITS, (fd_set *)vec_ro, (fd_set *)vec_wo, (fd_set *)vec_eo, &tv);
 #elif EV_SELECT_USE_FD_SET
   fd_setsize = anfdmax < FD_SETSIZE ? anfdmax : FD_SETSIZE;
+# if EV_USE_PSELECT
+  res = pselect (fd_setsize, (fd_set *)vec_ro, (fd_set *)vec_wo, 0, &tv, 0);
+# else
   res = select (fd_setsize, (fd_set *)vec_ro, (fd_set *)vec_wo, 0, &tv);
+# endif
+#elif EV_USE_PSELECT
+  /* pselect takes a timespec, which is all we need from it */
+  res = pselect (vec_max * NFDBITS, (fd_set *)vec_ro, (fd_set *)vec_wo, 0, &tv, 0);
 #else
   res = select (vec_max * NFDBITS, (fd_set *)vec_ro, (fd_set *)vec_wo, 0, &tv);
 #endif
@@ -221,11 +236,13 @@ select_poll (EV_P_ ev_tstamp timeout)
     int fd;
 
     for (fd = 0; fd < anfdmax; ++fd)
-      if (anfds [fd].events)
+      if (expect_false (!ANFD_PRESENT (fd)))
+        fd |= ANFD_PAGE_MASK;
+      else if (ANFD_AT (fd)->events)
         {
           int events = 0;
           #if EV_SELECT_IS_WINSOCKET
-          SOCKET handle = anfds [fd].handle;
+          SOCKET handle = ANFD_COLD_AT (fd)->handle;
           #else
           int handle = fd;
           #endif
@@ -274,7 +291,11 @@ select_poll (EV_P_ ev_tstamp timeout)
 int inline_size
 select_init (EV_P_ int flags)
 {
+#if EV_USE_PSELECT && !defined(_WIN32)
+  backend_mintime = 1e-9;
+#else
   backend_mintime = 1e-6;
+#endif
   backend_modify  = select_modify;
   backend_poll    = select_poll;
 
@@ -39,12 +39,14 @@
 
 #define VARx(type,name) VAR(name, type name)
 
-VARx(ev_tstamp, now_floor) /* last time we refreshed rt_time */
-VARx(ev_tstamp, mn_now)    /* monotonic clock "now" */
-VARx(ev_tstamp, rtmn_diff) /* difference realtime - monotonic time */
+VARx(ev_time_t, now_floor) /* last time we refreshed rt_time */
+VARx(ev_time_t, mn_now)    /* monotonic clock "now" */
+VARx(ev_time_t, rtmn_diff) /* difference realtime - monotonic time */
 
 VARx(ev_tstamp, io_blocktime)
 VARx(ev_tstamp, timeout_blocktime)
+VARx(ev_tstamp, timer_slack)     /* the fraction of its timeout a timer may be delayed */
+VARx(ev_tstamp, timer_slack_max) /* but never more than this */
 
 VARx(int, backend)
 VARx(int, activecnt) /* total number of active events ("refcount") */
@@ -55,19 +57,46 @@ VARx(ev_tstamp, backend_mintime) /* assumed typical timer resolution */
 VAR (backend_modify, void (*backend_modify)(EV_P_ int fd, int oev, int nev))
 VAR (backend_poll  , void (*backend_poll)(EV_P_ ev_tstamp timeout))
 
+#if !EV_USE_ANFD_PAGES || EV_GENWRAP
 VARx(ANFD *, anfds)
+#endif
+#if EV_USE_ANFD_PAGES || EV_GENWRAP
+VARx(ANFD **, anfdpages)
+VARx(int, anfdpagemax)
+#endif
 VARx(int, anfdmax)
+#if (EV_ANFD_COLD && !EV_USE_ANFD_PAGES) || EV_GENWRAP
+VARx(ANFD_COLD *, anfdcolds)
+VARx(int, anfdcoldmax)
+#endif
 
 VAR (pendings, ANPENDING *pendings [NUMPRI])
 VAR (pendingmax, int pendingmax [NUMPRI])
 VAR (pendingcnt, int pendingcnt [NUMPRI])
+VAR (pendingbits, uint32_t pendingbits [PRIWORDS]) /* priorities that might have pending watchers */
+VAR (pendinghead, int pendinghead [NUMPRI]) /* next pending watcher to invoke, in fifo order */
 VARx(ev_prepare, pending_w) /* dummy pending watcher */
+VARx(char, pending_fifo) /* EVFLAG_FIFO */
+VARx(unsigned int, invoke_budget) /* maximum callbacks per ev_invoke_pending, or 0 */
+VARx(ev_time_t, invoke_time_budget) /* maximum time per ev_invoke_pending, or 0 */
+
+/* pending watchers left over by the invoke budget */
+VARx(ANPENDING *, deferreds)
+VARx(int, deferredmax)
+VARx(int, deferredcnt)
 
 /* for reverse feeding of events */
 VARx(W *, rfeeds)
 VARx(int, rfeedmax)
 VARx(int, rfeedcnt)
 
+VAR (loop_alloc, void *(*loop_alloc)(EV_P_ void *ptr, long size)) /* ev_set_loop_allocator, or 0 */
+VARx(char, loop_allocated) /* whether the loop has allocated memory through loop_realloc */
+VARx(unsigned int, shrink_interval) /* iterations between loop_shrink calls, or 0 */
+VARx(unsigned int, shrink_countdown)
+VARx(struct ev_once *, once_free) /* free ev_once records */
+VARx(struct ev_once_slab *, once_slabs)
+
 #if EV_USE_EVENTFD || EV_GENWRAP
 VARx(int, evfd)
 #endif
@@ -107,6 +136,30 @@ VARx(int, epoll_eventmax)
 VARx(int *, epoll_eperms)
 VARx(int, epoll_epermcnt)
 VARx(int, epoll_epermmax)
+VARx(char, epoll_use_pwait2) /* whether the kernel has epoll_pwait2 */
+#endif
+
+#if EV_USE_IOURING || EV_GENWRAP
+VARx(void *, iouring_sq_ring)
+VARx(void *, iouring_cq_ring)
+VARx(struct io_uring_sqe *, iouring_sqes)
+VARx(unsigned int, iouring_sq_ring_size)
+VARx(unsigned int, iouring_cq_ring_size)
+VARx(unsigned int, iouring_sqes_size)
+VARx(unsigned int, iouring_entries) /* number of sqes to ask for */
+VARx(unsigned int, iouring_to_submit) /* number of queued, but unsubmitted sqes */
+
+/* offsets of the kernel-shared ring variables */
+VARx(unsigned int, iouring_sq_head)
+VARx(unsigned int, iouring_sq_tail)
+VARx(unsigned int, iouring_sq_ring_mask)
+VARx(unsigned int, iouring_sq_ring_entries)
+VARx(unsigned int, iouring_sq_array)
+VARx(unsigned int, iouring_cq_head)
+VARx(unsigned int, iouring_cq_tail)
+VARx(unsigned int, iouring_cq_ring_mask)
+VARx(unsigned int, iouring_cq_overflow)
+VARx(unsigned int, iouring_cq_cqes)
 #endif
 
 #if EV_USE_KQUEUE || EV_GENWRAP
@@ -129,11 +182,24 @@ VARx(HANDLE, iocp)
 VARx(int *, fdchanges)
 VARx(int, fdchangemax)
 VARx(int, fdchangecnt)
+VARx(unsigned int, fdchange_elided) /* number of backend changes we could avoid */
+VARx(unsigned int, exclusive_count) /* number of events received for EV_EXCLUSIVE fds */
 
 VARx(ANHE *, timers)
 VARx(int, timermax)
 VARx(int, timercnt)
 
+#if EV_USE_TIMER_WHEEL || EV_GENWRAP
+VARx(ANTW *, twnodes) /* node 0 is never used */
+VARx(int, twnodemax)
+VARx(int, twnodecnt)
+VARx(int, twfree) /* list of free nodes */
+VARx(int, twcnt) /* number of timers in the wheel */
+VARx(uint64_t, twtick) /* all timers up to this tick have been moved to the heap */
+VAR (twbits, uint64_t twbits [TW_LEVELS]) /* which slots are non-empty */
+VAR (twslots, int twslots [TW_OVERFLOW + 1])
+#endif
+
 #if EV_PERIODIC_ENABLE || EV_GENWRAP
 VARx(ANHE *, periodics)
 VARx(int, periodicmax)
@@ -144,6 +210,7 @@ VARx(int, periodiccnt)
 VAR (idles, ev_idle **idles [NUMPRI])
 VAR (idlemax, int idlemax [NUMPRI])
 VAR (idlecnt, int idlecnt [NUMPRI])
+VAR (idlebits, uint32_t idlebits [PRIWORDS]) /* priorities with idle watchers */
 #endif
 VARx(int, idleall) /* total number */
 
@@ -172,6 +239,10 @@ VARx(EV_ATOMIC_T, async_pending)
 VARx(struct ev_async **, asyncs)
 VARx(int, asyncmax)
 VARx(int, asynccnt)
+VAR (asyncsum, unsigned int volatile asyncsum [ASYNC_CHUNKS]) /* one bit per word in the chunk */
+VAR (asyncbits, unsigned int volatile *asyncbits [ASYNC_CHUNKS]) /* one bit per watcher */
+VARx(int, asyncchunks) /* number of allocated chunks */
+VARx(EV_ATOMIC_T, async_overflow) /* a watcher beyond ASYNC_MAX was sent */
 #endif
 
 #if EV_USE_INOTIFY || EV_GENWRAP
@@ -194,6 +265,17 @@ VARx(unsigned int, origflags) /* original loop flags */
 VARx(unsigned int, loop_count) /* total number of loop iterations/blocks */
 VARx(unsigned int, loop_depth) /* #ev_run enters - #ev_run leaves */
 
+VARx(ev_tstamp, io_collect_max) /* adapt io_blocktime up to this, if nonzero */
+VARx(ev_tstamp, busy_poll) /* spin this long before blocking, if nonzero */
+VARx(char, busy_spinning) /* true while busy_spin polls, to skip release_cb */
+
+VARx(struct ev_loop_stats, loop_stats)
+VARx(char, loop_stats_timing)
+VARx(char, loop_stats_cbs) /* ev_loop_stats_callbacks */
+VARx(char, cb_timing) /* loop_stats_cbs || slow_cb */
+VARx(ev_tstamp, slow_threshold)
+VAR (slow_cb, void (*slow_cb)(EV_P_ void *w, int revents, ev_tstamp elapsed))
+
 VARx(void *, userdata)
 VAR (release_cb, void (*release_cb)(EV_P))
 VAR (acquire_cb, void (*acquire_cb)(EV_P))
@@ -6,6 +6,8 @@
 #define rtmn_diff ((loop)->rtmn_diff)
 #define io_blocktime ((loop)->io_blocktime)
 #define timeout_blocktime ((loop)->timeout_blocktime)
+#define timer_slack ((loop)->timer_slack)
+#define timer_slack_max ((loop)->timer_slack_max)
 #define backend ((loop)->backend)
 #define activecnt ((loop)->activecnt)
 #define loop_done ((loop)->loop_done)
@@ -14,14 +16,32 @@
 #define backend_modify ((loop)->backend_modify)
 #define backend_poll ((loop)->backend_poll)
 #define anfds ((loop)->anfds)
+#define anfdpages ((loop)->anfdpages)
+#define anfdpagemax ((loop)->anfdpagemax)
 #define anfdmax ((loop)->anfdmax)
+#define anfdcolds ((loop)->anfdcolds)
+#define anfdcoldmax ((loop)->anfdcoldmax)
 #define pendings ((loop)->pendings)
 #define pendingmax ((loop)->pendingmax)
 #define pendingcnt ((loop)->pendingcnt)
+#define pendingbits ((loop)->pendingbits)
+#define pendinghead ((loop)->pendinghead)
 #define pending_w ((loop)->pending_w)
+#define pending_fifo ((loop)->pending_fifo)
+#define invoke_budget ((loop)->invoke_budget)
+#define invoke_time_budget ((loop)->invoke_time_budget)
+#define deferreds ((loop)->deferreds)
+#define deferredmax ((loop)->deferredmax)
+#define deferredcnt ((loop)->deferredcnt)
 #define rfeeds ((loop)->rfeeds)
 #define rfeedmax ((loop)->rfeedmax)
 #define rfeedcnt ((loop)->rfeedcnt)
+#define loop_alloc ((loop)->loop_alloc)
+#define loop_allocated ((loop)->loop_allocated)
+#define shrink_interval ((loop)->shrink_interval)
+#define shrink_countdown ((loop)->shrink_countdown)
+#define once_free ((loop)->once_free)
+#define once_slabs ((loop)->once_slabs)
 #define evfd ((loop)->evfd)
 #define evpipe ((loop)->evpipe)
 #define pipe_w ((loop)->pipe_w)
@@ -45,6 +65,25 @@
 #define epoll_eperms ((loop)->epoll_eperms)
 #define epoll_epermcnt ((loop)->epoll_epermcnt)
 #define epoll_epermmax ((loop)->epoll_epermmax)
+#define epoll_use_pwait2 ((loop)->epoll_use_pwait2)
+#define iouring_sq_ring ((loop)->iouring_sq_ring)
+#define iouring_cq_ring ((loop)->iouring_cq_ring)
+#define iouring_sqes ((loop)->iouring_sqes)
+#define iouring_sq_ring_size ((loop)->iouring_sq_ring_size)
+#define iouring_cq_ring_size ((loop)->iouring_cq_ring_size)
+#define iouring_sqes_size ((loop)->iouring_sqes_size)
+#define iouring_entries ((loop)->iouring_entries)
+#define iouring_to_submit ((loop)->iouring_to_submit)
+#define iouring_sq_head ((loop)->iouring_sq_head)
+#define iouring_sq_tail ((loop)->iouring_sq_tail)
+#define iouring_sq_ring_mask ((loop)->iouring_sq_ring_mask)
+#define iouring_sq_ring_entries ((loop)->iouring_sq_ring_entries)
+#define iouring_sq_array ((loop)->iouring_sq_array)
+#define iouring_cq_head ((loop)->iouring_cq_head)
+#define iouring_cq_tail ((loop)->iouring_cq_tail)
+#define iouring_cq_ring_mask ((loop)->iouring_cq_ring_mask)
+#define iouring_cq_overflow ((loop)->iouring_cq_overflow)
+#define iouring_cq_cqes ((loop)->iouring_cq_cqes)
 #define kqueue_changes ((loop)->kqueue_changes)
 #define kqueue_changemax ((loop)->kqueue_changemax)
 #define kqueue_changecnt ((loop)->kqueue_changecnt)
@@ -56,15 +95,26 @@
 #define fdchanges ((loop)->fdchanges)
 #define fdchangemax ((loop)->fdchangemax)
 #define fdchangecnt ((loop)->fdchangecnt)
+#define fdchange_elided ((loop)->fdchange_elided)
+#define exclusive_count ((loop)->exclusive_count)
 #define timers ((loop)->timers)
 #define timermax ((loop)->timermax)
 #define timercnt ((loop)->timercnt)
+#define twnodes ((loop)->twnodes)
+#define twnodemax ((loop)->twnodemax)
+#define twnodecnt ((loop)->twnodecnt)
+#define twfree ((loop)->twfree)
+#define twcnt ((loop)->twcnt)
+#define twtick ((loop)->twtick)
+#define twbits ((loop)->twbits)
+#define twslots ((loop)->twslots)
 #define periodics ((loop)->periodics)
 #define periodicmax ((loop)->periodicmax)
 #define periodiccnt ((loop)->periodiccnt)
 #define idles ((loop)->idles)
 #define idlemax ((loop)->idlemax)
 #define idlecnt ((loop)->idlecnt)
+#define idlebits ((loop)->idlebits)
 #define idleall ((loop)->idleall)
 #define prepares ((loop)->prepares)
 #define preparemax ((loop)->preparemax)
@@ -82,6 +132,10 @@
 #define asyncs ((loop)->asyncs)
 #define asyncmax ((loop)->asyncmax)
 #define asynccnt ((loop)->asynccnt)
+#define asyncsum ((loop)->asyncsum)
+#define asyncbits ((loop)->asyncbits)
+#define asyncchunks ((loop)->asyncchunks)
+#define async_overflow ((loop)->async_overflow)
 #define fs_fd ((loop)->fs_fd)
 #define fs_w ((loop)->fs_w)
 #define fs_2625 ((loop)->fs_2625)
@@ -93,6 +147,15 @@
 #define origflags ((loop)->origflags)
 #define loop_count ((loop)->loop_count)
 #define loop_depth ((loop)->loop_depth)
+#define io_collect_max ((loop)->io_collect_max)
+#define busy_poll ((loop)->busy_poll)
+#define busy_spinning ((loop)->busy_spinning)
+#define loop_stats ((loop)->loop_stats)
+#define loop_stats_timing ((loop)->loop_stats_timing)
+#define loop_stats_cbs ((loop)->loop_stats_cbs)
+#define cb_timing ((loop)->cb_timing)
+#define slow_threshold ((loop)->slow_threshold)
+#define slow_cb ((loop)->slow_cb)
 #define userdata ((loop)->userdata)
 #define release_cb ((loop)->release_cb)
 #define acquire_cb ((loop)->acquire_cb)
@@ -104,6 +167,8 @@
 #undef rtmn_diff
 #undef io_blocktime
 #undef timeout_blocktime
+#undef timer_slack
+#undef timer_slack_max
 #undef backend
 #undef activecnt
 #undef loop_done
@@ -112,14 +177,32 @@
 #undef backend_modify
 #undef backend_poll
 #undef anfds
+#undef anfdpages
+#undef anfdpagemax
 #undef anfdmax
+#undef anfdcolds
+#undef anfdcoldmax
 #undef pendings
 #undef pendingmax
 #undef pendingcnt
+#undef pendingbits
+#undef pendinghead
 #undef pending_w
+#undef pending_fifo
+#undef invoke_budget
+#undef invoke_time_budget
+#undef deferreds
+#undef deferredmax
+#undef deferredcnt
 #undef rfeeds
 #undef rfeedmax
 #undef rfeedcnt
+#undef loop_alloc
+#undef loop_allocated
+#undef shrink_interval
+#undef shrink_countdown
+#undef once_free
+#undef once_slabs
 #undef evfd
 #undef evpipe
 #undef pipe_w
@@ -143,6 +226,25 @@
 #undef epoll_eperms
 #undef epoll_epermcnt
 #undef epoll_epermmax
+#undef epoll_use_pwait2
+#undef iouring_sq_ring
+#undef iouring_cq_ring
+#undef iouring_sqes
+#undef iouring_sq_ring_size
+#undef iouring_cq_ring_size
+#undef iouring_sqes_size
+#undef iouring_entries
+#undef iouring_to_submit
+#undef iouring_sq_head
+#undef iouring_sq_tail
+#undef iouring_sq_ring_mask
+#undef iouring_sq_ring_entries
+#undef iouring_sq_array
+#undef iouring_cq_head
+#undef iouring_cq_tail
+#undef iouring_cq_ring_mask
+#undef iouring_cq_overflow
+#undef iouring_cq_cqes
 #undef kqueue_changes
 #undef kqueue_changemax
 #undef kqueue_changecnt
@@ -154,15 +256,26 @@
 #undef fdchanges
 #undef fdchangemax
 #undef fdchangecnt
+#undef fdchange_elided
+#undef exclusive_count
 #undef timers
 #undef timermax
 #undef timercnt
+#undef twnodes
+#undef twnodemax
+#undef twnodecnt
+#undef twfree
+#undef twcnt
+#undef twtick
+#undef twbits
+#undef twslots
 #undef periodics
 #undef periodicmax
 #undef periodiccnt
 #undef idles
 #undef idlemax
 #undef idlecnt
+#undef idlebits
 #undef idleall
 #undef prepares
 #undef preparemax
@@ -180,6 +293,10 @@
 #undef asyncs
 #undef asyncmax
 #undef asynccnt
+#undef asyncsum
+#undef asyncbits
+#undef asyncchunks
+#undef async_overflow
 #undef fs_fd
 #undef fs_w
 #undef fs_2625
@@ -191,6 +308,15 @@
 #undef origflags
 #undef loop_count
 #undef loop_depth
+#undef io_collect_max
+#undef busy_poll
+#undef busy_spinning
+#undef loop_stats
+#undef loop_stats_timing
+#undef loop_stats_cbs
+#undef cb_timing
+#undef slow_threshold
+#undef slow_cb
 #undef userdata
 #undef release_cb
 #undef acquire_cb